@@ -2,21 +2,108 @@
 #include "cache_bus.h"
 
 namespace Cached {
-    int Digital::read(bool inverse_read) {
-        if (inverse_read) {
-            data = !input.get().read();
-        } else {
-            data = input.get().read();
+    template class ChannelStats<int>;
+    template class ChannelStats<float>;
+    template class ChannelStats<uint16_t>;
+
+    void record_floats(SampleHistory<float> *history, ChannelStats<float> *stats,
+            const size_t *channels, const float *values, size_t count, uint32_t stamp) {
+        if (!channels) {
+            if (history) {
+                history->push_all(values, stamp);
+            }
+            if (stats) {
+                stats->add_all(values);
+            }
+            return;
+        }
+
+        if (history) {
+            history->push_each(channels, values, count, stamp);
+        }
+        if (stats) {
+            stats->add_each(channels, values, count);
+        }
+    }
+
+#if DEVICE_INTERRUPTIN
+    InterruptDigital::InterruptDigital(InterruptIn &input) : 
+        input(input), data(0), inverse(false) {
+        // handlers first, an edge between the read and the attach would be lost
+        input.rise([this] { edge(1); });
+        input.fall([this] { edge(0); });
+        resync(false);
+        stamp.set(0, Timestamps<1>::now());
+    }
+
+    InterruptDigital::~InterruptDigital() {
+        input.rise(nullptr);
+        input.fall(nullptr);
+    }
+
+    void InterruptDigital::resync(bool inverse_read) {
+        input.disable_irq();
+        inverse = inverse_read;
+        data = (input.read() != 0) ^ inverse_read;
+        input.enable_irq();
+    }
+#endif
+
+#if DEVICE_PORTIN
+    bool port_location(PinName pin, PortName &port, uint32_t &bit) {
+        if (pin == NC) {
+            return false;
+        }
+
+    #if defined(STM_PORT)
+        port = static_cast<PortName>(STM_PORT(pin));
+        bit = STM_PIN(pin);
+        return true;
+    #else
+        for (int p = 0; p < 16; ++p) {
+            for (uint32_t b = 0; b < 32U; ++b) {
+                if (port_pin(static_cast<PortName>(p), b) == pin) {
+                    port = static_cast<PortName>(p);
+                    bit = b;
+                    return true;
+                }
+            }
         }
-        return data;
+        return false;
+    #endif
     }
 
-    float Analog::read(bool inverse_read) {
-        if (inverse_read) {
-            data = (1.0f - input.get().read());
-        } else {
-            data = input.get().read();
+    size_t group_by_port(const PinName *pins, size_t count, size_t max_ports,
+            PortName *ports, uint32_t *masks, uint8_t *port_of, uint8_t *bit_of) {
+        size_t groups = 0;
+
+        for (size_t i = 0; i < count; ++i) {
+            PortName port;
+            uint32_t bit;
+            if (!port_location(pins[i], port, bit)) {
+                return 0;
+            }
+
+            size_t group = 0;
+            while (group < groups && ports[group] != port) {
+                ++group;
+            }
+
+            if (group == groups) {
+                if (groups == max_ports) {
+                    return 0;
+                }
+                ports[groups] = port;
+                masks[groups] = 0;
+                ++groups;
+            }
+
+            masks[group] |= 1U << bit;
+            port_of[i] = static_cast<uint8_t>(group);
+            bit_of[i] = static_cast<uint8_t>(bit);
         }
-        return data;
+
+        return groups;
     }
-}
\ No newline at end of file
+#endif
+}
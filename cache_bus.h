@@ -5,147 +5,2009 @@
 #include <mstd_tuple>
 #include <mstd_functional>
 #include <mstd_type_traits>
+#include <mstd_atomic>
+#include <mstd_span>
+#include <chrono>
 #include <initializer_list>
+#include <new>
 
 namespace Cached {
     #define OUT_OF_BOUNDS_ERROR "error: Bus index out of bounds"
+    #define DANGLING_INPUT_ERROR "error: Bus keeps references to its inputs, pass named inputs or use InPlaceBus"
+
+    #ifndef CACHED_BUS_MAX_PORTS
+    #define CACHED_BUS_MAX_PORTS 8
+    #endif
+
+    // set to 0 to drop the per-channel read timestamps of every bus, get_fresh
+    // then always reads. a single bus opts out with its Stamped argument instead,
+    // e.g. DBus<64, false>
+    #ifndef CACHED_BUS_TIMESTAMPS
+    #define CACHED_BUS_TIMESTAMPS 1
+    #endif
+
+    // us_ticker time of the last read of each channel. a stamp is never 0, which
+    // marks a channel that was never read; ages wrap after about 71 minutes
+    template <size_t N, bool Enabled = CACHED_BUS_TIMESTAMPS>
+    class Timestamps {
+    public:
+        static uint32_t now() {
+            return us_ticker_read() | 1U;
+        }
+
+        Timestamps() : stamps {} {}
+
+        void set(size_t index, uint32_t stamp) {
+            stamps[index] = stamp;
+        }
+
+        void set_all(uint32_t stamp) {
+            for (auto &s : stamps) {
+                s = stamp;
+            }
+        }
+
+        uint32_t get(size_t index) const {
+            return stamps[index];
+        }
+
+        bool fresh(size_t index, std::chrono::microseconds max_age) const {
+            return stamps[index] && now() - stamps[index] <= static_cast<uint32_t>(max_age.count());
+        }
+
+    private:
+        uint32_t stamps[N];
+    };
+
+    // no storage and no clock reads, every stamp reads 0 and nothing is fresh
+    template <size_t N>
+    class Timestamps<N, false> {
+    public:
+        static uint32_t now() {
+            return 0;
+        }
+
+        void set(size_t, uint32_t) {}
+
+        void set_all(uint32_t) {}
+
+        uint32_t get(size_t) const {
+            return 0;
+        }
+
+        bool fresh(size_t, std::chrono::microseconds) const {
+            return false;
+        }
+    };
+
+    // type-erased channel, for collections mixing channel kinds behind one interface
+    template <class In, class Data>
+    class InputRead {
+    public:
+        virtual Data read(bool inverse_read) = 0;
+
+        operator Data();
+
+        Data read_cached() const {
+            return data;
+        }
+
+        uint32_t timestamp() const {
+            return stamp.get(0);
+        }
+
+        bool fresh(std::chrono::microseconds max_age) const {
+            return stamp.fresh(0, max_age);
+        }
+
+        // cached value if read within max_age, otherwise a new read
+        Data read_fresh(std::chrono::microseconds max_age, bool inverse_read = false) {
+            return fresh(max_age) ? data : read(inverse_read);
+        }
+
+        // replaces the cached value, e.g. with a filtered one
+        Data cache(Data value) {
+            return data = value;
+        }
+
+        // the cached value itself, later reads show through
+        const Data &cached() const {
+            return data;
+        }
+
+        InputRead(In& input);
+        InputRead(const InputRead &) = delete;
+        InputRead& operator =(const InputRead&) = delete; 
+
+        InputRead(InputRead &&) = default;
+
+        virtual ~InputRead() = default;
+        
+    protected:
+        mstd::reference_wrapper<In> input;
+        Data data;
+        Timestamps<1> stamp;
+    };
+
+    // statically dispatched channel, Derived provides
+    // static Data sample(In &input, bool inverse_read)
+    template <class Derived, class In, class Data>
+    class StaticInputRead {
+    public:
+        using input_type = In;
+        using data_type = Data;
+
+        Data read(bool inverse_read = false) {
+            return read(inverse_read, Timestamps<1>::now());
+        }
+
+        // read stamped with the time of a whole bus refresh
+        Data read(bool inverse_read, uint32_t now) {
+            stamp.set(0, now);
+            return data = Derived::sample(input.get(), inverse_read);
+        }
+
+        operator Data() {
+            return data;
+        }
+
+        Data read_cached() const {
+            return data;
+        }
+
+        uint32_t timestamp() const {
+            return stamp.get(0);
+        }
+
+        bool fresh(std::chrono::microseconds max_age) const {
+            return stamp.fresh(0, max_age);
+        }
+
+        // cached value if read within max_age, otherwise a new read
+        Data read_fresh(std::chrono::microseconds max_age, bool inverse_read = false) {
+            return fresh(max_age) ? data : read(inverse_read);
+        }
+
+        // replaces the cached value, e.g. with a filtered one
+        Data cache(Data value) {
+            return data = value;
+        }
+
+        // the cached value itself, later reads show through
+        const Data &cached() const {
+            return data;
+        }
+
+        StaticInputRead(In& input) : input(input) {}
+        StaticInputRead(const StaticInputRead &) = delete;
+        StaticInputRead& operator =(const StaticInputRead&) = delete; 
+
+        StaticInputRead(StaticInputRead &&) = default;
+
+    protected:
+        mstd::reference_wrapper<In> input;
+        Data data;
+        Timestamps<1> stamp;
+    };
+
+    class Digital : public StaticInputRead<Digital, DigitalIn, int> {
+    public:
+        using StaticInputRead::StaticInputRead;
+        static int sample(DigitalIn &input, bool inverse_read);
+    };
+
+    class Analog : public StaticInputRead<Analog, AnalogIn, float> {
+    public:
+        using StaticInputRead::StaticInputRead;
+        static float sample(AnalogIn &input, bool inverse_read);
+    };
+
+    // raw 16-bit samples, no float math on the read path
+    class AnalogU16 : public StaticInputRead<AnalogU16, AnalogIn, uint16_t> {
+    public:
+        using StaticInputRead::StaticInputRead;
+        static uint16_t sample(AnalogIn &input, bool inverse_read);
+
+        static float to_float(uint16_t raw) {
+            return raw * (1.0f / 0xFFFF);
+        }
+    };
+
+    // K raw 16-bit samples per read, summed as integers and decimated to one float,
+    // e.g. Bus<AnalogAvg<16>, N>. mix factors per channel in a VBus
+    template <unsigned K>
+    class AnalogAvg : public StaticInputRead<AnalogAvg<K>, AnalogIn, float> {
+        static_assert(K >= 1U && K <= 65536U, "error: oversampling factor must be in 1..65536");
+
+    public:
+        using StaticInputRead<AnalogAvg<K>, AnalogIn, float>::StaticInputRead;
+        static float sample(AnalogIn &input, bool inverse_read);
+    };
+
+    // channel wired active low, reads come back inverted without a runtime flag,
+    // e.g. VBus<Digital, Inverted<Digital>>
+    template <class T>
+    class Inverted : public T {
+    public:
+        using T::T;
+
+        typename T::data_type read(bool inverse_read = false) {
+            return T::read(!inverse_read);
+        }
+
+        typename T::data_type read(bool inverse_read, uint32_t now) {
+            return T::read(!inverse_read, now);
+        }
+
+        static typename T::data_type sample(typename T::input_type &input, bool inverse_read) {
+            return T::sample(input, !inverse_read);
+        }
+    };
+
+    // opt-in virtual wrapper, Virtual<Digital> is an InputRead<DigitalIn, int>
+    template <class T>
+    class Virtual : public InputRead<typename T::input_type, typename T::data_type> {
+    public:
+        using input_type = typename T::input_type;
+        using data_type = typename T::data_type;
+
+        static data_type sample(input_type &input, bool inverse_read) {
+            return T::sample(input, inverse_read);
+        }
+
+        using InputRead<typename T::input_type, data_type>::InputRead;
+
+        data_type read(bool inverse_read = false) override {
+            return read(inverse_read, Timestamps<1>::now());
+        }
+
+        data_type read(bool inverse_read, uint32_t now) {
+            this->stamp.set(0, now);
+            return this->data = T::sample(this->input.get(), inverse_read);
+        }
+    };
+
+#if DEVICE_INTERRUPTIN
+    // digital channel cached from the rise/fall interrupts of its InterruptIn, so
+    // the cache always holds the level after the last edge and a read touches no
+    // hardware. mix with polled channels in a VBus, e.g. VBus<Analog, InterruptDigital>.
+    // the channel owns the InterruptIn callbacks and cannot be moved
+    class InterruptDigital : private NonCopyable<InterruptDigital> {
+    public:
+        using input_type = InterruptIn;
+        using data_type = int;
+
+        InterruptDigital(InterruptIn &input);
+        ~InterruptDigital();
+
+        int read(bool inverse_read = false) {
+            return read(inverse_read, Timestamps<1>::now());
+        }
+
+        // nothing to sample, the cache is current as of now
+        int read(bool inverse_read, uint32_t now) {
+            if (inverse_read != inverse) {
+                resync(inverse_read);
+            }
+            stamp.set(0, now);
+            return read_cached();
+        }
+
+        operator int() {
+            return read_cached();
+        }
+
+        // volatile load, the level changes under the reader
+        int read_cached() const {
+            return *static_cast<const volatile int *>(&data);
+        }
+
+        uint32_t timestamp() const {
+            return stamp.get(0);
+        }
+
+        bool fresh(std::chrono::microseconds max_age) const {
+            return stamp.fresh(0, max_age);
+        }
+
+        int read_fresh(std::chrono::microseconds, bool inverse_read = false) {
+            return read(inverse_read);
+        }
+
+        // replaced again by the next edge
+        int cache(int value) {
+            return data = value;
+        }
+
+        // the cached level itself, later edges show through
+        const int &cached() const {
+            return data;
+        }
+
+    private:
+        void edge(int level) {
+            data = level ^ inverse;
+            stamp.set(0, Timestamps<1>::now());
+        }
+
+        // polarity changed, reads the pin once with the edges held off
+        void resync(bool inverse_read);
+
+        InterruptIn &input;
+        int data;
+        bool inverse;
+        Timestamps<1> stamp;
+    };
+#endif
+
+    inline int Digital::sample(DigitalIn &input, bool inverse_read) {
+        return (input.read() != 0) ^ inverse_read;
+    }
+
+    inline float Analog::sample(AnalogIn &input, bool inverse_read) {
+        float value = input.read();
+        return inverse_read ? 1.0f - value : value;
+    }
+
+    inline uint16_t AnalogU16::sample(AnalogIn &input, bool inverse_read) {
+        return input.read_u16() ^ (inverse_read ? 0xFFFFU : 0U);
+    }
+
+    template <unsigned K>
+    float AnalogAvg<K>::sample(AnalogIn &input, bool inverse_read) {
+        uint32_t sum = 0;
+        for (unsigned i = 0; i < K; ++i) {
+            sum += input.read_u16();
+        }
+        if (inverse_read) {
+            sum = K * 0xFFFFU - sum;
+        }
+        return sum * (1.0f / (K * 65535.0f));
+    }
+
+    // single writer sequence lock guarding a bus cache. readers retry instead of
+    // blocking the writer, so a reader must not preempt the writer (e.g. an ISR
+    // interrupting the thread that refreshes the bus), use try_snapshot there.
+    // write sections nest, only the outermost one is published
+    class SeqLock {
+    public:
+        SeqLock() : seq {0}, depth {0} {}
+        SeqLock(SeqLock &&other) : seq {other.seq.load(mstd::memory_order_relaxed)}, depth {0} {}
+
+        SeqLock& operator =(SeqLock &&other) {
+            seq.store(other.seq.load(mstd::memory_order_relaxed), mstd::memory_order_relaxed);
+            return *this;
+        }
+
+        void write_begin() {
+            if (depth++ == 0) {
+                seq.store(seq.load(mstd::memory_order_relaxed) + 1U, mstd::memory_order_relaxed);
+                mstd::atomic_thread_fence(mstd::memory_order_release);
+            }
+        }
+
+        void write_end() {
+            if (--depth == 0) {
+                seq.store(seq.load(mstd::memory_order_relaxed) + 1U, mstd::memory_order_release);
+            }
+        }
+
+        uint32_t read_begin() const {
+            return seq.load(mstd::memory_order_acquire);
+        }
+
+        bool read_valid(uint32_t start) const {
+            mstd::atomic_thread_fence(mstd::memory_order_acquire);
+            return !(start & 1U) && seq.load(mstd::memory_order_relaxed) == start;
+        }
+
+    private:
+        mstd::atomic<uint32_t> seq;
+        uint8_t depth;
+    };
+
+    // consistent copy of every cached value of a bus
+    template <class Data, size_t N>
+    struct Snapshot {
+        Data values[N];
+
+        template <size_t I>
+        Data get() const {
+            static_assert(I < N, OUT_OF_BOUNDS_ERROR);
+            return values[I];
+        }
+
+        Data operator [](size_t index) const {
+            return values[index];
+        }
+    };
+
+    template <size_t N>
+    using bus_integer = mstd::conditional_t<N <= 8U, uint8_t,
+                        mstd::conditional_t<N <= 16U, uint16_t,
+                        mstd::conditional_t<N <= 32U, uint32_t, uint64_t>>>;
+
+    // set of channels of an N channel bus, channel i in bit i % 32 of words[i / 32]
+    template <size_t N>
+    struct ChannelMask {
+        static constexpr size_t WORDS = (N + 31U) / 32U;
+
+        // channels of the last word, bits above N are never set
+        static constexpr uint32_t LAST_WORD = N % 32U ? (1U << (N % 32U)) - 1U : 0xFFFFFFFFU;
+
+        uint32_t words[WORDS];
+
+        // channels 0 to 63 from an integer, channel i in bit i. bits from N
+        // up are dropped, so ~0 selects every channel
+        static ChannelMask from_integer(uint64_t value) {
+            ChannelMask mask {};
+            for (size_t w = 0; w < WORDS && w < 2U; ++w) {
+                mask.words[w] = static_cast<uint32_t>(value >> (32U * w));
+            }
+            mask.words[WORDS - 1U] &= LAST_WORD;
+            return mask;
+        }
+
+        // ids from N up are dropped
+        static ChannelMask of(mstd::initializer_list<size_t> ids) {
+            ChannelMask mask {};
+            for (auto id : ids) {
+                if (id < N) {
+                    mask.set(id);
+                }
+            }
+            return mask;
+        }
+
+        template <size_t I>
+        bool test() const {
+            static_assert(I < N, OUT_OF_BOUNDS_ERROR);
+            return (words[I / 32U] >> (I % 32U)) & 1U;
+        }
+
+        bool test(size_t index) const {
+            return (words[index / 32U] >> (index % 32U)) & 1U;
+        }
+
+        void set(size_t index) {
+            words[index / 32U] |= 1U << (index % 32U);
+        }
+
+        void clear() {
+            for (auto &word : words) {
+                word = 0;
+            }
+        }
+
+        bool any() const {
+            uint32_t acc = 0;
+            for (auto word : words) {
+                acc |= word;
+            }
+            return acc != 0;
+        }
+    };
+
+    // index of the lowest set bit, word must not be 0
+    inline uint32_t lowest_bit(uint32_t word) {
+        return static_cast<uint32_t>(__builtin_ctz(word));
+    }
+
+    // the index pack of a read<I...>, sorted and without duplicates at compile time
+    template <size_t ...I>
+    struct ReadPlan {
+        struct Indices {
+            size_t ids[sizeof...(I)];
+            size_t count;
+        };
+
+        static constexpr Indices make() {
+            Indices out {{I...}, 0};
+            for (size_t i = 1; i < sizeof...(I); ++i) {
+                for (size_t j = i; j > 0 && out.ids[j - 1U] > out.ids[j]; --j) {
+                    size_t t = out.ids[j];
+                    out.ids[j] = out.ids[j - 1U];
+                    out.ids[j - 1U] = t;
+                }
+            }
+            for (size_t i = 0; i < sizeof...(I); ++i) {
+                if (out.count == 0 || out.ids[out.count - 1U] != out.ids[i]) {
+                    out.ids[out.count++] = out.ids[i];
+                }
+            }
+            return out;
+        }
+
+        static constexpr Indices plan = make();
+    };
+
+    template <class Plan, size_t ...K>
+    mstd::index_sequence<Plan::plan.ids[K]...> plan_sequence(mstd::index_sequence<K...>);
+
+    // read_plan<3, 1, 3> is index_sequence<1, 3>
+    template <size_t ...I>
+    using read_plan = decltype(plan_sequence<ReadPlan<I...>>(
+        mstd::make_index_sequence<ReadPlan<I...>::plan.count>()));
+
+    // true if now moved away from before by more than deadband
+    template <class Data>
+    bool exceeds(Data before, Data now, Data deadband) {
+        return (now > before ? now - before : before - now) > deadband;
+    }
+
+    // deadband given as a fraction of full scale, in the units of Data.
+    // digital levels change on any difference
+    template <class Data>
+    Data scaled_deadband(float fraction);
+
+    template <>
+    inline int scaled_deadband<int>(float) {
+        return 0;
+    }
+
+    template <>
+    inline float scaled_deadband<float>(float fraction) {
+        return fraction;
+    }
+
+    template <>
+    inline uint16_t scaled_deadband<uint16_t>(float fraction) {
+        return static_cast<uint16_t>(fraction * 0xFFFF);
+    }
+
+    // cached values in the fixed point the filters run on, a 16-bit full scale
+    // with 8 fractional bits
+    template <class Data>
+    struct FilterScale;
+
+    template <>
+    struct FilterScale<float> {
+        static int32_t to_fixed(float value) {
+            return static_cast<int32_t>(value * (65535.0f * 256.0f));
+        }
+
+        static float from_fixed(int32_t value) {
+            return value * (1.0f / (65535.0f * 256.0f));
+        }
+    };
+
+    template <>
+    struct FilterScale<uint16_t> {
+        static int32_t to_fixed(uint16_t value) {
+            return static_cast<int32_t>(value) << 8;
+        }
+
+        static uint16_t from_fixed(int32_t value) {
+            return static_cast<uint16_t>((value + 128) >> 8);
+        }
+    };
+
+    template <>
+    struct FilterScale<int> {
+        static int32_t to_fixed(int value) {
+            return static_cast<int32_t>(value) << 8;
+        }
+
+        static int from_fixed(int32_t value) {
+            return (value + 128) >> 8;
+        }
+    };
+
+    // per-channel exponential moving average y += (x - y) / 2^shift, run over
+    // the values entering the cache of the bus it is attached to, e.g.
+    //     Ema<4> lowpass;
+    //     lowpass.set_shift(3);
+    //     abus.set_filter(&lowpass);
+    // shift 0 passes samples through, a channel starts from its first sample
+    template <size_t N>
+    class Ema : private NonCopyable<Ema<N>> {
+    public:
+        static constexpr uint8_t MAX_SHIFT = 15;
+
+        Ema() : state {}, shift {}, primed {} {}
+
+        void set_shift(size_t index, uint8_t shift) {
+            MBED_ASSERT(shift <= MAX_SHIFT);
+            this->shift[index] = shift;
+            primed[index / 32U] &= ~(1U << (index % 32U));
+        }
+
+        void set_shift(uint8_t shift) {
+            for (size_t i = 0; i < N; ++i) {
+                set_shift(i, shift);
+            }
+        }
+
+        template <class Data>
+        Data update(size_t index, Data sample) {
+            int32_t x = FilterScale<Data>::to_fixed(sample);
+            uint32_t bit = 1U << (index % 32U);
+            if (!(primed[index / 32U] & bit)) {
+                primed[index / 32U] |= bit;
+                state[index] = x;
+            }
+            state[index] += (x - state[index]) >> shift[index];
+            return FilterScale<Data>::from_fixed(state[index]);
+        }
+
+    private:
+        int32_t state[N];
+        uint8_t shift[N];
+        uint32_t primed[(N + 31U) / 32U];
+    };
+
+    // the last samples of each channel of a bus with their read times, one ring
+    // per channel overwriting its oldest sample. History<Data, N, K> provides
+    // the storage, this is what a bus records into
+    template <class Data>
+    class SampleHistory : private NonCopyable<SampleHistory<Data>> {
+    public:
+        size_t channels() const {
+            return count;
+        }
+
+        size_t capacity() const {
+            return depth;
+        }
+
+        // samples held for channel, up to capacity()
+        size_t size(size_t channel) const {
+            return cursors[channel].filled;
+        }
+
+        // sample of channel age reads back, 0 is the newest
+        Data value(size_t channel, size_t age) const {
+            return values[slot(channel, age)];
+        }
+
+        uint32_t stamp(size_t channel, size_t age) const {
+            return stamps[slot(channel, age)];
+        }
+
+        // the samples of channel oldest first, as two contiguous runs: segment 0
+        // then segment 1, which stays empty until the ring wraps. no copy, a
+        // later push shows through
+        mstd::span<const Data> values_of(size_t channel, size_t segment) const {
+            return {values + channel * depth + first(channel, segment), length(channel, segment)};
+        }
+
+        mstd::span<const uint32_t> stamps_of(size_t channel, size_t segment) const {
+            return {stamps + channel * depth + first(channel, segment), length(channel, segment)};
+        }
+
+        void push(size_t channel, Data value, uint32_t stamp) {
+            Cursor &cursor = cursors[channel];
+            size_t at = channel * depth + cursor.next;
+            values[at] = value;
+            stamps[at] = stamp;
+            cursor.next = cursor.next + 1U == depth ? 0 : cursor.next + 1U;
+            cursor.filled += cursor.filled < depth;
+        }
+
+        // one sample for every channel, channel i from values[i]
+        void push_all(const Data *from, uint32_t stamp) {
+            Data *row = values;
+            uint32_t *times = stamps;
+            for (size_t i = 0; i < count; ++i, row += depth, times += depth) {
+                Cursor cursor = cursors[i];
+                row[cursor.next] = from[i];
+                times[cursor.next] = stamp;
+                cursor.next = cursor.next + 1U == depth ? 0 : cursor.next + 1U;
+                cursor.filled += cursor.filled < depth;
+                cursors[i] = cursor;
+            }
+        }
+
+        // one sample of each of n channels, channels[i] from values[i]
+        void push_each(const size_t *channels, const Data *from, size_t n, uint32_t stamp) {
+            for (size_t i = 0; i < n; ++i) {
+                push(channels[i], from[i], stamp);
+            }
+        }
+
+        void clear() {
+            for (size_t i = 0; i < count; ++i) {
+                cursors[i] = {};
+            }
+        }
+
+    protected:
+        struct Cursor {
+            uint16_t next;
+            uint16_t filled;
+        };
+
+        SampleHistory(Data *values, uint32_t *stamps, Cursor *cursors, size_t count, size_t depth) : 
+            values(values), stamps(stamps), cursors(cursors), count(count), depth(depth) {}
+
+    private:
+        size_t slot(size_t channel, size_t age) const {
+            MBED_ASSERT(age < size(channel));
+            const Cursor &cursor = cursors[channel];
+            return channel * depth + (cursor.next + depth - 1U - age) % depth;
+        }
+
+        size_t first(size_t channel, size_t segment) const {
+            const Cursor &cursor = cursors[channel];
+            return segment == 0 && cursor.filled == depth ? cursor.next : 0;
+        }
+
+        size_t length(size_t channel, size_t segment) const {
+            const Cursor &cursor = cursors[channel];
+            if (cursor.filled < depth) {
+                return segment == 0 ? cursor.filled : 0;
+            }
+            return segment == 0 ? depth - cursor.next : cursor.next;
+        }
+
+        Data *values;
+        uint32_t *stamps;
+        Cursor *cursors;
+        size_t count;
+        size_t depth;
+    };
+
+    // K samples for each of N channels, statically sized, e.g.
+    //     History<float, 4, 32> history;
+    //     abus.set_history(&history);
+    template <class Data, size_t N, size_t K>
+    class History : public SampleHistory<Data> {
+        static_assert(K >= 1U && K <= 0xFFFFU, "error: history depth must be in 1..65535");
+
+    public:
+        History() : SampleHistory<Data>(storage[0], times[0], cursors, N, K), storage {}, times {}, cursors {} {}
+
+    private:
+        using typename SampleHistory<Data>::Cursor;
+
+        Data storage[N][K];
+        uint32_t times[N][K];
+        Cursor cursors[N];
+    };
+
+    // running moments of one channel. floats use Welford's update, integer
+    // channels keep exact sums of values and squares, so no divide per sample
+    template <class Data, class = void>
+    struct Moments {
+        float mean;
+        float m2;
+
+        void add(Data value, uint32_t count) {
+            float delta = value - mean;
+            mean += delta / count;
+            m2 += delta * (value - mean);
+        }
+
+        float average(uint32_t) const {
+            return mean;
+        }
+
+        float variance(uint32_t count) const {
+            return count ? m2 / count : 0.0f;
+        }
+    };
+
+    template <class Data>
+    struct Moments<Data, mstd::enable_if_t<mstd::is_integral<Data>::value>> {
+        int64_t sum;
+        uint64_t squares;
+
+        void add(Data value, uint32_t) {
+            sum += value;
+            squares += static_cast<uint64_t>(static_cast<int64_t>(value) * value);
+        }
+
+        float average(uint32_t count) const {
+            return count ? static_cast<float>(static_cast<double>(sum) / count) : 0.0f;
+        }
+
+        float variance(uint32_t count) const {
+            if (!count) {
+                return 0.0f;
+            }
+            double mean = static_cast<double>(sum) / count;
+            return static_cast<float>(static_cast<double>(squares) / count - mean * mean);
+        }
+    };
+
+    // min, max, mean and (population) variance of each channel of a bus over the
+    // current window, updated as values enter the cache. RunningStats<Data, N>
+    // provides the storage, this is what a bus adds to. a window lasts until
+    // reset(), or restart() from a context other than the one refreshing the bus
+    template <class Data>
+    class ChannelStats : private NonCopyable<ChannelStats<Data>> {
+    public:
+        size_t channels() const {
+            return width;
+        }
+
+        // one sample of every channel, channel i from values[i]
+        void add_all(const Data *values);
+
+        void add(size_t channel, Data value);
+
+        // one sample of each of count channels, channels[i] from values[i]
+        void add_each(const size_t *channels, const Data *values, size_t count);
+
+        // samples of channel in the window
+        uint32_t count(size_t channel) const {
+            return counts[channel];
+        }
+
+        Data min(size_t channel) const {
+            return lows[channel];
+        }
+
+        Data max(size_t channel) const {
+            return highs[channel];
+        }
+
+        float mean(size_t channel) const {
+            return moments[channel].average(counts[channel]);
+        }
+
+        float variance(size_t channel) const {
+            return moments[channel].variance(counts[channel]);
+        }
+
+        // starts a new window now, from the context refreshing the bus
+        void reset();
+
+        // starts a new window with the next sample, safe from any context
+        void restart() {
+            restarting.store(true, mstd::memory_order_release);
+        }
+
+    protected:
+        ChannelStats(uint32_t *counts, Data *lows, Data *highs, Moments<Data> *moments, size_t width) : 
+            counts(counts), lows(lows), highs(highs), moments(moments), width(width), restarting {false} {}
+
+    private:
+        void begin() {
+            if (restarting.load(mstd::memory_order_relaxed) && restarting.exchange(false, mstd::memory_order_acquire)) {
+                reset();
+            }
+        }
+
+        void update(size_t channel, Data value) {
+            uint32_t count = ++counts[channel];
+            lows[channel] = count == 1U || value < lows[channel] ? value : lows[channel];
+            highs[channel] = count == 1U || value > highs[channel] ? value : highs[channel];
+            moments[channel].add(value, count);
+        }
+
+        uint32_t *counts;
+        Data *lows;
+        Data *highs;
+        Moments<Data> *moments;
+        size_t width;
+        mstd::atomic<bool> restarting;
+    };
+
+    template <class Data>
+    void ChannelStats<Data>::add_all(const Data *values) {
+        begin();
+        for (size_t i = 0; i < width; ++i) {
+            update(i, values[i]);
+        }
+    }
+
+    template <class Data>
+    void ChannelStats<Data>::add(size_t channel, Data value) {
+        begin();
+        update(channel, value);
+    }
+
+    template <class Data>
+    void ChannelStats<Data>::add_each(const size_t *channels, const Data *values, size_t count) {
+        begin();
+        for (size_t i = 0; i < count; ++i) {
+            update(channels[i], values[i]);
+        }
+    }
+
+    template <class Data>
+    void ChannelStats<Data>::reset() {
+        for (size_t i = 0; i < width; ++i) {
+            counts[i] = 0;
+            moments[i] = {};
+        }
+    }
+
+    // built once in cache_bus.cpp for the cached data types, buses only carry the calls
+    extern template class ChannelStats<int>;
+    extern template class ChannelStats<float>;
+    extern template class ChannelStats<uint16_t>;
+
+    // statistics of N channels, statically sized, e.g.
+    //     RunningStats<float, 4> stats;
+    //     abus.set_stats(&stats);
+    template <class Data, size_t N>
+    class RunningStats : public ChannelStats<Data> {
+    public:
+        RunningStats() : ChannelStats<Data>(counts, lows, highs, moments, N), counts {}, lows {}, highs {}, moments {} {}
+
+    private:
+        uint32_t counts[N];
+        Data lows[N];
+        Data highs[N];
+        Moments<Data> moments[N];
+    };
+
+    // the new values of a VBus into whichever of history and stats is attached,
+    // channels[i] from values[i], or every channel in order when channels is
+    // nullptr. built once in cache_bus.cpp, buses only carry the call
+    void record_floats(SampleHistory<float> *history, ChannelStats<float> *stats,
+        const size_t *channels, const float *values, size_t count, uint32_t stamp);
+
+    // buses reference their inputs, a temporary input would dangle
+    template <class ...T>
+    constexpr bool all_lvalues = (mstd::is_lvalue_reference<T>::value && ...);
+
+    // storage and read paths of a bus over channels of type T, sampled through
+    // the static T::sample. cached values are kept in one contiguous array apart
+    // from the inputs
+    template <class T, size_t N, bool Stamped>
+    class BasicBus : private NonCopyable<BasicBus<T, N, Stamped>> {
+    protected:
+        using input_type = typename T::input_type;
+        using data_type = typename T::data_type;
+
+        data_type data[N];
+        input_type *inputs[N];
+
+    private:
+        SeqLock seq;
+        Timestamps<N, Stamped> stamps;
+        data_type deadband;
+        Ema<N> *ema;
+        ChannelMask<N> polarity;
+        SampleHistory<data_type> *history;
+        ChannelStats<data_type> *stats;
+
+        bool inverted(size_t index, bool inverse_read) const {
+            return polarity.test(index) ^ inverse_read;
+        }
+
+        data_type sample(size_t index, bool inverse_read) {
+            data_type value = T::sample(*inputs[index], inverted(index, inverse_read));
+            return data[index] = ema ? ema->update(index, value) : value;
+        }
+
+        void record(size_t index, uint32_t now) {
+            if (history) {
+                history->push(index, data[index], now);
+            }
+            if (stats) {
+                stats->add(index, data[index]);
+            }
+        }
+
+    public:
+        using snapshot_type = Snapshot<data_type, N>;
+
+        template <class ...PT>
+        BasicBus(PT&& ...list);
+
+        template <size_t I>
+        auto get();
+
+        // cached value if channel I was read within max_age, otherwise a new read
+        template <size_t I>
+        auto get_fresh(std::chrono::microseconds max_age, bool inverse_read = false);
+
+        template <size_t I>
+        uint32_t timestamp() const;
+
+        auto operator [](size_t index);
+
+        // all cached values, channel i at index i
+        const data_type *values() const {
+            return data;
+        }
+
+        void read_all(bool inverse_read = false);
+
+        // also marks in changed the channels that moved by more than the deadband
+        void read_all(ChannelMask<N> &changed, bool inverse_read = false);
+
+        void set_deadband(data_type deadband) {
+            this->deadband = deadband;
+        }
+
+        // channels set in inverted are read inverted, inverse_read flips on top
+        void set_polarity(const ChannelMask<N> &inverted) {
+            polarity = inverted;
+        }
+
+        // every read also low-pass filters the new values through ema before
+        // they enter the cache, which must outlive the bus. nullptr stops
+        void set_filter(Ema<N> *ema) {
+            this->ema = ema;
+        }
+
+        // every read also records the new cached values into history, which
+        // must outlive the bus. nullptr stops
+        template <size_t K>
+        void set_history(History<data_type, N, K> *history) {
+            this->history = history;
+        }
+
+        void set_history(decltype(nullptr)) {
+            history = nullptr;
+        }
+
+        // every read also adds the new cached values to stats, which must
+        // outlive the bus. nullptr stops
+        void set_stats(RunningStats<data_type, N> *stats) {
+            this->stats = stats;
+        }
+
+        template <size_t I>
+        void read(bool inverse_read = false);
+
+        // each listed channel is read once, in index order
+        template <size_t I, size_t In, size_t ...Index>
+        void read(bool inverse_read = false);
+
+        void read(mstd::initializer_list<size_t> ids, bool inverse_read = false);
+
+        // reads the channels set in mask, in index order
+        void read_mask(const ChannelMask<N> &mask, bool inverse_read = false);
+
+        void read_mask(bus_integer<N> mask, bool inverse_read = false) {
+            static_assert(N <= 64U, "error: Bus wider than 64 channels, use a ChannelMask");
+            read_mask(ChannelMask<N>::from_integer(mask), inverse_read);
+        }
+
+        // consistent cut of all cached values, retries while a refresh is in progress
+        snapshot_type snapshot() const;
+
+        // single attempt, false if a refresh was in progress
+        bool try_snapshot(snapshot_type &out) const;
+
+    private:
+        template <size_t ...Ids>
+        void read_planned(bool inverse_read, mstd::index_sequence<Ids...>);
+    };
+
+    // generic bus over channels of type T. Stamped keeps a read time per channel
+    template <class T, size_t N, bool Stamped = CACHED_BUS_TIMESTAMPS>
+    class Bus : public BasicBus<T, N, Stamped> {
+    public:
+        using BasicBus<T, N, Stamped>::BasicBus;
+    };
+
+    template <class In, class Data>
+    InputRead<In, Data>::InputRead(In &input) : input(input) {}
+
+    template <class In, class Data>
+    InputRead<In, Data>::operator Data() {
+        return data;
+    }
+
+    template <class T, size_t N, bool Stamped>
+    template <class ...PT>
+    BasicBus<T, N, Stamped>::BasicBus(PT&& ...list) : 
+        data {}, inputs {&static_cast<input_type &>(list)...}, deadband {}, ema {nullptr}, polarity {}, history {nullptr}, stats {nullptr} {
+        static_assert(sizeof...(PT) == N, "error: Bus needs one input per channel");
+        static_assert(all_lvalues<PT...>, DANGLING_INPUT_ERROR);
+    }
+
+    template <class T, size_t N, bool Stamped>
+    auto BasicBus<T, N, Stamped>::operator [](size_t index) {
+        return data[index];
+    }
+
+    template <class T, size_t N, bool Stamped>
+    void BasicBus<T, N, Stamped>::read_all(bool inverse_read) {
+        uint32_t now = Timestamps<N, Stamped>::now();
+        stamps.set_all(now);
+        seq.write_begin();
+        for (size_t i = 0; i < N; ++i) {
+            data[i] = T::sample(*inputs[i], inverted(i, inverse_read));
+        }
+        if (ema) {
+            for (size_t i = 0; i < N; ++i) {
+                data[i] = ema->update(i, data[i]);
+            }
+        }
+        if (history) {
+            history->push_all(data, now);
+        }
+        if (stats) {
+            stats->add_all(data);
+        }
+        seq.write_end();
+    }
+
+    template <class T, size_t N, bool Stamped>
+    void BasicBus<T, N, Stamped>::read_all(ChannelMask<N> &changed, bool inverse_read) {
+        uint32_t now = Timestamps<N, Stamped>::now();
+        stamps.set_all(now);
+        seq.write_begin();
+        for (size_t w = 0; w < ChannelMask<N>::WORDS; ++w) {
+            uint32_t word = 0;
+            for (size_t b = 0; b < 32U && w * 32U + b < N; ++b) {
+                size_t i = w * 32U + b;
+                data_type before = data[i];
+                word |= static_cast<uint32_t>(exceeds(before, sample(i, inverse_read), deadband)) << b;
+                record(i, now);
+            }
+            changed.words[w] = word;
+        }
+        seq.write_end();
+    }
+
+    template <class T, size_t N, bool Stamped>
+    template <size_t I>
+    auto BasicBus<T, N, Stamped>::get() {
+        static_assert(I < N, OUT_OF_BOUNDS_ERROR);
+
+        return data[I];
+    }
+
+    template <class T, size_t N, bool Stamped>
+    template <size_t I>
+    auto BasicBus<T, N, Stamped>::get_fresh(std::chrono::microseconds max_age, bool inverse_read) {
+        static_assert(I < N, OUT_OF_BOUNDS_ERROR);
+
+        if (!stamps.fresh(I, max_age)) {
+            read<I>(inverse_read);
+        }
+        return data[I];
+    }
+
+    template <class T, size_t N, bool Stamped>
+    template <size_t I>
+    uint32_t BasicBus<T, N, Stamped>::timestamp() const {
+        static_assert(I < N, OUT_OF_BOUNDS_ERROR);
+
+        return stamps.get(I);
+    }
+
+    template <class T, size_t N, bool Stamped>
+    template <size_t I>
+    void BasicBus<T, N, Stamped>::read(bool inverse_read) {
+        static_assert(I < N, OUT_OF_BOUNDS_ERROR);
+        uint32_t now = Timestamps<N, Stamped>::now();
+        stamps.set(I, now);
+        seq.write_begin();
+        sample(I, inverse_read);
+        record(I, now);
+        seq.write_end();
+    }
+
+    template <class T, size_t N, bool Stamped>
+    template <size_t I, size_t In, size_t ...Index>
+    void BasicBus<T, N, Stamped>::read(bool inverse_read) {
+        read_planned(inverse_read, read_plan<I, In, Index...>());
+    }
+
+    template <class T, size_t N, bool Stamped>
+    template <size_t ...Ids>
+    void BasicBus<T, N, Stamped>::read_planned(bool inverse_read, mstd::index_sequence<Ids...>) {
+        static_assert(((Ids < N) && ...), OUT_OF_BOUNDS_ERROR);
+
+        uint32_t now = Timestamps<N, Stamped>::now();
+        seq.write_begin();
+        (sample(Ids, inverse_read), ...);
+        (stamps.set(Ids, now), ...);
+        (record(Ids, now), ...);
+        seq.write_end();
+    }
+
+    template <class T, size_t N, bool Stamped>
+    auto BasicBus<T, N, Stamped>::snapshot() const -> snapshot_type {
+        snapshot_type out;
+        while (!try_snapshot(out)) {}
+        return out;
+    }
+
+    template <class T, size_t N, bool Stamped>
+    bool BasicBus<T, N, Stamped>::try_snapshot(snapshot_type &out) const {
+        uint32_t start = seq.read_begin();
+        for (size_t i = 0; i < N; ++i) {
+            out.values[i] = data[i];
+        }
+        return seq.read_valid(start);
+    }
+
+    template <class T, size_t N, bool Stamped>
+    void BasicBus<T, N, Stamped>::read(mstd::initializer_list<size_t> ids, bool inverse_read) {
+        read_mask(ChannelMask<N>::of(ids), inverse_read);
+    }
+
+    template <class T, size_t N, bool Stamped>
+    void BasicBus<T, N, Stamped>::read_mask(const ChannelMask<N> &mask, bool inverse_read) {
+        uint32_t now = Timestamps<N, Stamped>::now();
+        seq.write_begin();
+        for (size_t w = 0; w < ChannelMask<N>::WORDS; ++w) {
+            for (uint32_t bits = mask.words[w]; bits; bits &= bits - 1U) {
+                size_t i = w * 32U + lowest_bit(bits);
+                sample(i, inverse_read);
+                stamps.set(i, now);
+                record(i, now);
+            }
+        }
+        seq.write_end();
+    }
+
+#if DEVICE_PORTIN
+    bool port_location(PinName pin, PortName &port, uint32_t &bit);
+
+    size_t group_by_port(const PinName *pins, size_t count, size_t max_ports,
+        PortName *ports, uint32_t *masks, uint8_t *port_of, uint8_t *bit_of);
+
+    // digital channels grouped by GPIO port, read with one masked port read per port
+    template <size_t N>
+    class PortGroups : private NonCopyable<PortGroups<N>> {
+    public:
+        static constexpr size_t MAX_PORTS = N < CACHED_BUS_MAX_PORTS ? N : CACHED_BUS_MAX_PORTS;
+
+        PortGroups(const PinName (&pins)[N]);
+        ~PortGroups();
+
+        size_t size() const {
+            return count;
+        }
+
+        // packs the level of channel i into bit i % 32 of words[i / 32]
+        void read_all(uint32_t *words);
+
+        uint32_t read(size_t index);
+
+        // bit of the group holding channel index
+        uint32_t group_bit(size_t index) const {
+            return 1U << port_of[index];
+        }
+
+        // one read of every group set in groups, values indexed by group
+        void read_groups(uint32_t groups, uint32_t *values);
+
+        // level of channel index from values filled by read_groups
+        uint32_t level(size_t index, const uint32_t *values) const {
+            return (values[port_of[index]] >> bit_of[index]) & 1U;
+        }
+
+    private:
+        PortIn &port(size_t group) {
+            return *reinterpret_cast<PortIn *>(storage[group]);
+        }
+
+        alignas(PortIn) unsigned char storage[MAX_PORTS][sizeof(PortIn)];
+        size_t count;
+        uint8_t port_of[N];
+        uint8_t bit_of[N];
+    };
+
+    template <size_t N>
+    PortGroups<N>::PortGroups(const PinName (&pins)[N]) {
+        PortName names[MAX_PORTS];
+        uint32_t masks[MAX_PORTS];
+
+        count = group_by_port(pins, N, MAX_PORTS, names, masks, port_of, bit_of);
+        if (count == 0) {
+            // not even a release build may go on, reads would cache whatever the groups held
+            MBED_ERROR(MBED_MAKE_ERROR(MBED_MODULE_DRIVER_GPIO, MBED_ERROR_CODE_INVALID_ARGUMENT),
+                "Bus pins must be connected GPIOs spanning at most CACHED_BUS_MAX_PORTS ports");
+        }
+
+        for (size_t group = 0; group < count; ++group) {
+            new (storage[group]) PortIn(names[group], static_cast<int>(masks[group]));
+        }
+    }
+
+    template <size_t N>
+    PortGroups<N>::~PortGroups() {
+        for (size_t group = 0; group < count; ++group) {
+            port(group).~PortIn();
+        }
+    }
+
+    template <size_t N>
+    void PortGroups<N>::read_all(uint32_t *words) {
+        uint32_t values[MAX_PORTS] = {};
+        for (size_t group = 0; group < count; ++group) {
+            values[group] = static_cast<uint32_t>(port(group).read());
+        }
+
+        for (size_t w = 0; w * 32U < N; ++w) {
+            uint32_t word = 0;
+            for (size_t b = 0; b < 32U && w * 32U + b < N; ++b) {
+                size_t i = w * 32U + b;
+                word |= ((values[port_of[i]] >> bit_of[i]) & 1U) << b;
+            }
+            words[w] = word;
+        }
+    }
+
+    template <size_t N>
+    void PortGroups<N>::read_groups(uint32_t groups, uint32_t *values) {
+        while (groups) {
+            uint32_t group = lowest_bit(groups);
+            values[group] = static_cast<uint32_t>(port(group).read());
+            groups &= groups - 1U;
+        }
+    }
+
+    template <size_t N>
+    uint32_t PortGroups<N>::read(size_t index) {
+        return (static_cast<uint32_t>(port(port_of[index]).read()) >> bit_of[index]) & 1U;
+    }
+#endif
+
+    template <class ...T>
+    using if_pin_names = mstd::enable_if_t<(mstd::is_same<mstd::decay_t<T>, PinName>::value && ...), int>;
+
+    template <class ...T>
+    using if_not_pin_names = mstd::enable_if_t<!(mstd::is_same<mstd::decay_t<T>, PinName>::value && ...), int>;
+
+    // consistent copy of the packed levels of a digital bus
+    template <size_t N>
+    struct PackedSnapshot {
+        uint32_t words[(N + 31U) / 32U];
+
+        template <size_t I>
+        int get() const {
+            static_assert(I < N, OUT_OF_BOUNDS_ERROR);
+            return static_cast<int>((words[I / 32U] >> (I % 32U)) & 1U);
+        }
+
+        int operator [](size_t index) const {
+            return static_cast<int>((words[index / 32U] >> (index % 32U)) & 1U);
+        }
+    };
+
+    // bit-parallel debounce of packed levels, one 2-bit vertical counter per channel.
+    // a channel takes a new level after it was sampled 4 times in a row
+    template <size_t WORDS>
+    struct VerticalDebounce {
+        uint32_t count0[WORDS];
+        uint32_t count1[WORDS];
+
+        void reset() {
+            for (size_t w = 0; w < WORDS; ++w) {
+                count0[w] = 0;
+                count1[w] = 0;
+            }
+        }
+
+        // feeds the channels in mask of sample into the debounced word state
+        void update(size_t w, uint32_t &state, uint32_t sample, uint32_t mask) {
+            uint32_t delta = (sample ^ state) & mask;
+            uint32_t keep = ~mask;
+            count1[w] = ((count1[w] ^ count0[w]) & delta) | (count1[w] & keep);
+            count0[w] = (~count0[w] & delta) | (count0[w] & keep);
+            state ^= delta & ~(count0[w] | count1[w]);
+        }
+    };
+
+    // digital bus, either reading each DigitalIn on its own or, when constructed
+    // from pin names, reading every GPIO port it spans once per refresh.
+    // cached levels are packed one bit per channel, 32 channels per word. there is
+    // no set_stats, the min, max and mean of a level say little a count of edges
+    // would not
+    template <size_t N, bool Stamped>
+    class Bus<Digital, N, Stamped> : private NonCopyable<Bus<Digital, N, Stamped>> {
+    public:
+        static constexpr size_t WORDS = (N + 31U) / 32U;
+
+    private:
+        static constexpr uint32_t LAST_WORD_MASK = N % 32U ? (1U << (N % 32U)) - 1U : ~0U;
+
+        uint32_t bits[WORDS];
+        union {
+            DigitalIn *pins[N];
+        #if DEVICE_PORTIN
+            PortGroups<N> ports;
+        #endif
+        };
+        bool batched;
+        bool debouncing;
+        SeqLock seq;
+        Timestamps<N, Stamped> stamps;
+        VerticalDebounce<WORDS> debounce;
+        uint32_t polarity[WORDS];
+
+        uint32_t polarity_bit(size_t index) const {
+            return (polarity[index / 32U] >> (index % 32U)) & 1U;
+        }
+
+        static constexpr uint32_t word_mask(size_t w) {
+            return w + 1U < WORDS ? ~0U : LAST_WORD_MASK;
+        }
+
+        void store(size_t index, uint32_t level) {
+            uint32_t mask = 1U << (index % 32U);
+            if (debouncing) {
+                debounce.update(index / 32U, bits[index / 32U], level << (index % 32U), mask);
+            } else {
+                bits[index / 32U] = (bits[index / 32U] & ~mask) | (level << (index % 32U));
+            }
+        }
+
+        int read_pin(size_t index, bool inverse_read);
+
+    public:
+        using snapshot_type = PackedSnapshot<N>;
+
+        template <class ...PT, if_not_pin_names<PT...> = 0>
+        Bus(PT&& ...list);
+
+    #if DEVICE_PORTIN
+        template <class ...PT, if_pin_names<PT...> = 0>
+        Bus(PT ...names);
+    #endif
+
+        ~Bus();
+
+        template <size_t I>
+        auto get();
+
+        // cached level if channel I was read within max_age, otherwise a new read
+        template <size_t I>
+        auto get_fresh(std::chrono::microseconds max_age, bool inverse_read = false);
+
+        template <size_t I>
+        uint32_t timestamp() const;
+
+        auto operator [](size_t index);
+
+        // the whole bus as an integer, channel i in bit i
+        bus_integer<N> as_integer() const;
+
+        // packed levels, channel i in bit i % 32 of word i / 32
+        const uint32_t *words() const {
+            return bits;
+        }
+
+        // channels set in inverted are read inverted (active low), inverse_read
+        // flips on top. applied with one XOR per 32 channels
+        void set_polarity(const ChannelMask<N> &inverted) {
+            for (size_t w = 0; w < WORDS; ++w) {
+                polarity[w] = inverted.words[w] & word_mask(w);
+            }
+        }
+
+        // with debouncing on, the cached level of a channel only follows the pin
+        // once 4 reads in a row agree
+        void set_debounce(bool enable) {
+            debounce.reset();
+            debouncing = enable;
+        }
+
+        void read_all(bool inverse_read = false);
+
+        // also marks in changed the channels whose level flipped
+        void read_all(ChannelMask<N> &changed, bool inverse_read = false);
+
+        template <size_t I>
+        void read(bool inverse_read = false);
+
+        // each listed channel is read once, a pin name bus reads each port once
+        template <size_t I, size_t In, size_t ...Index>
+        void read(bool inverse_read = false);
+
+        void read(mstd::initializer_list<size_t> ids, bool inverse_read = false);
+
+        // reads the channels set in mask, a pin name bus reads each port once
+        void read_mask(const ChannelMask<N> &mask, bool inverse_read = false);
+
+        void read_mask(bus_integer<N> mask, bool inverse_read = false) {
+            static_assert(N <= 64U, "error: Bus wider than 64 channels, use a ChannelMask");
+            read_mask(ChannelMask<N>::from_integer(mask), inverse_read);
+        }
+
+        snapshot_type snapshot() const;
+
+        bool try_snapshot(snapshot_type &out) const;
+
+    private:
+        template <size_t ...Ids>
+        void read_planned(bool inverse_read, mstd::index_sequence<Ids...>);
+    };
+
+    template <size_t N, bool Stamped>
+    template <class ...PT, if_not_pin_names<PT...>>
+    Bus<Digital, N, Stamped>::Bus(PT&& ...list) : 
+        bits {}, pins {&static_cast<DigitalIn &>(list)...}, batched {false}, debouncing {false}, debounce {}, polarity {} {
+        static_assert(sizeof...(PT) == N, "error: Bus needs one input per channel");
+        static_assert(all_lvalues<PT...>, DANGLING_INPUT_ERROR);
+    }
+
+#if DEVICE_PORTIN
+    template <size_t N, bool Stamped>
+    template <class ...PT, if_pin_names<PT...>>
+    Bus<Digital, N, Stamped>::Bus(PT ...names) : 
+        bits {}, ports {{names...}}, batched {true}, debouncing {false}, debounce {}, polarity {} {
+        static_assert(sizeof...(PT) == N, "error: Bus needs one pin per channel");
+    }
+#endif
+
+    template <size_t N, bool Stamped>
+    Bus<Digital, N, Stamped>::~Bus() {
+    #if DEVICE_PORTIN
+        if (batched) {
+            ports.~PortGroups();
+        }
+    #endif
+    }
+
+    template <size_t N, bool Stamped>
+    int Bus<Digital, N, Stamped>::read_pin(size_t index, bool inverse_read) {
+        uint32_t level;
+    #if DEVICE_PORTIN
+        if (batched) {
+            level = ports.read(index);
+        } else
+    #endif
+        {
+            level = pins[index]->read() != 0;
+        }
+
+        level ^= inverse_read ^ polarity_bit(index);
+        store(index, level);
+        stamps.set(index, Timestamps<N, Stamped>::now());
+        return static_cast<int>((bits[index / 32U] >> (index % 32U)) & 1U);
+    }
+
+    template <size_t N, bool Stamped>
+    template <size_t I>
+    auto Bus<Digital, N, Stamped>::get() {
+        static_assert(I < N, OUT_OF_BOUNDS_ERROR);
+
+        return static_cast<int>((bits[I / 32U] >> (I % 32U)) & 1U);
+    }
+
+    template <size_t N, bool Stamped>
+    template <size_t I>
+    auto Bus<Digital, N, Stamped>::get_fresh(std::chrono::microseconds max_age, bool inverse_read) {
+        static_assert(I < N, OUT_OF_BOUNDS_ERROR);
+
+        if (!stamps.fresh(I, max_age)) {
+            read<I>(inverse_read);
+        }
+        return get<I>();
+    }
+
+    template <size_t N, bool Stamped>
+    template <size_t I>
+    uint32_t Bus<Digital, N, Stamped>::timestamp() const {
+        static_assert(I < N, OUT_OF_BOUNDS_ERROR);
+
+        return stamps.get(I);
+    }
+
+    template <size_t N, bool Stamped>
+    auto Bus<Digital, N, Stamped>::operator [](size_t index) {
+        return static_cast<int>((bits[index / 32U] >> (index % 32U)) & 1U);
+    }
+
+    template <size_t N, bool Stamped>
+    bus_integer<N> Bus<Digital, N, Stamped>::as_integer() const {
+        static_assert(N <= 64U, "error: Bus wider than 64 channels, use words()");
+
+        uint64_t value = bits[0];
+        if (WORDS > 1U) {
+            value |= static_cast<uint64_t>(bits[WORDS - 1U]) << 32U;
+        }
+        return static_cast<bus_integer<N>>(value);
+    }
+
+    template <size_t N, bool Stamped>
+    void Bus<Digital, N, Stamped>::read_all(bool inverse_read) {
+        uint32_t sample[WORDS];
+
+        stamps.set_all(Timestamps<N, Stamped>::now());
+        seq.write_begin();
+    #if DEVICE_PORTIN
+        if (batched) {
+            ports.read_all(sample);
+        } else
+    #endif
+        {
+            for (size_t w = 0; w < WORDS; ++w) {
+                uint32_t word = 0;
+                for (size_t b = 0; b < 32U && w * 32U + b < N; ++b) {
+                    word |= static_cast<uint32_t>(pins[w * 32U + b]->read() != 0) << b;
+                }
+                sample[w] = word;
+            }
+        }
+
+        uint32_t flip = inverse_read ? ~0U : 0U;
+        for (size_t w = 0; w < WORDS; ++w) {
+            uint32_t level = sample[w] ^ (flip & word_mask(w)) ^ polarity[w];
+            if (debouncing) {
+                debounce.update(w, bits[w], level, word_mask(w));
+            } else {
+                bits[w] = level;
+            }
+        }
+        seq.write_end();
+    }
+
+    template <size_t N, bool Stamped>
+    void Bus<Digital, N, Stamped>::read_all(ChannelMask<N> &changed, bool inverse_read) {
+        uint32_t before[WORDS];
+        for (size_t w = 0; w < WORDS; ++w) {
+            before[w] = bits[w];
+        }
+
+        read_all(inverse_read);
+
+        for (size_t w = 0; w < WORDS; ++w) {
+            changed.words[w] = before[w] ^ bits[w];
+        }
+    }
+
+    template <size_t N, bool Stamped>
+    template <size_t I>
+    void Bus<Digital, N, Stamped>::read(bool inverse_read) {
+        static_assert(I < N, OUT_OF_BOUNDS_ERROR);
+        seq.write_begin();
+        read_pin(I, inverse_read);
+        seq.write_end();
+    }
+
+    template <size_t N, bool Stamped>
+    template <size_t I, size_t In, size_t ...Index>
+    void Bus<Digital, N, Stamped>::read(bool inverse_read) {
+        read_planned(inverse_read, read_plan<I, In, Index...>());
+    }
+
+    template <size_t N, bool Stamped>
+    template <size_t ...Ids>
+    void Bus<Digital, N, Stamped>::read_planned(bool inverse_read, mstd::index_sequence<Ids...>) {
+        static_assert(((Ids < N) && ...), OUT_OF_BOUNDS_ERROR);
+
+        uint32_t flip = inverse_read;
+        uint32_t now = Timestamps<N, Stamped>::now();
+        seq.write_begin();
+    #if DEVICE_PORTIN
+        if (batched) {
+            uint32_t values[PortGroups<N>::MAX_PORTS] = {};
+            ports.read_groups((ports.group_bit(Ids) | ...), values);
+            (store(Ids, ports.level(Ids, values) ^ flip ^ polarity_bit(Ids)), ...);
+        } else
+    #endif
+        {
+            (store(Ids, static_cast<uint32_t>(pins[Ids]->read() != 0) ^ flip ^ polarity_bit(Ids)), ...);
+        }
+        (stamps.set(Ids, now), ...);
+        seq.write_end();
+    }
+
+    template <size_t N, bool Stamped>
+    void Bus<Digital, N, Stamped>::read(mstd::initializer_list<size_t> ids, bool inverse_read) {
+        read_mask(ChannelMask<N>::of(ids), inverse_read);
+    }
 
-    template <class In, class Data>
-    class InputRead {
-    public:
-        virtual Data read(bool inverse_read) = 0;
+    template <size_t N, bool Stamped>
+    void Bus<Digital, N, Stamped>::read_mask(const ChannelMask<N> &mask, bool inverse_read) {
+        uint32_t flip = inverse_read;
+        uint32_t now = Timestamps<N, Stamped>::now();
+        seq.write_begin();
+    #if DEVICE_PORTIN
+        if (batched) {
+            uint32_t groups = 0;
+            for (size_t w = 0; w < WORDS; ++w) {
+                for (uint32_t bits = mask.words[w]; bits; bits &= bits - 1U) {
+                    groups |= ports.group_bit(w * 32U + lowest_bit(bits));
+                }
+            }
 
-        operator Data();
+            uint32_t values[PortGroups<N>::MAX_PORTS] = {};
+            ports.read_groups(groups, values);
+            for (size_t w = 0; w < WORDS; ++w) {
+                for (uint32_t bits = mask.words[w]; bits; bits &= bits - 1U) {
+                    size_t i = w * 32U + lowest_bit(bits);
+                    store(i, ports.level(i, values) ^ flip ^ polarity_bit(i));
+                    stamps.set(i, now);
+                }
+            }
+        } else
+    #endif
+        {
+            for (size_t w = 0; w < WORDS; ++w) {
+                for (uint32_t bits = mask.words[w]; bits; bits &= bits - 1U) {
+                    size_t i = w * 32U + lowest_bit(bits);
+                    store(i, static_cast<uint32_t>(pins[i]->read() != 0) ^ flip ^ polarity_bit(i));
+                    stamps.set(i, now);
+                }
+            }
+        }
+        seq.write_end();
+    }
 
-        Data read_cached() {
-            return data;
+    template <size_t N, bool Stamped>
+    auto Bus<Digital, N, Stamped>::snapshot() const -> snapshot_type {
+        snapshot_type out;
+        while (!try_snapshot(out)) {}
+        return out;
+    }
+
+    template <size_t N, bool Stamped>
+    bool Bus<Digital, N, Stamped>::try_snapshot(snapshot_type &out) const {
+        uint32_t start = seq.read_begin();
+        for (size_t w = 0; w < WORDS; ++w) {
+            out.words[w] = bits[w];
         }
+        return seq.read_valid(start);
+    }
 
-        InputRead(In& input);
-        InputRead(const InputRead &) = delete;
-        InputRead& operator =(const InputRead&) = delete; 
+    template <size_t N, bool Stamped = CACHED_BUS_TIMESTAMPS>
+    using DBus = Bus<Digital, N, Stamped>;
 
-        InputRead(InputRead &&) = default;
-        
-    protected:
-        mstd::reference_wrapper<In> input;
-        Data data;
-    };
+    template <size_t N, bool Stamped = CACHED_BUS_TIMESTAMPS>
+    using ABus = Bus<Analog, N, Stamped>;
 
-    class Digital : public InputRead<DigitalIn, int> {
-    public:
-        using InputRead::InputRead;
-        int read(bool inverse_read = false) override;
-    };
+    // analog bus averaging K samples per channel on every read
+    template <size_t N, unsigned K, bool Stamped = CACHED_BUS_TIMESTAMPS>
+    using ABusAvg = Bus<AnalogAvg<K>, N, Stamped>;
 
-    class Analog : public InputRead<AnalogIn, float> {
+    // analog bus caching raw 16-bit samples, converted to float or volts on access.
+    // set_stats takes RunningStats<uint16_t, N> and keeps them in raw steps
+    template <size_t N, bool Stamped>
+    class Bus<AnalogU16, N, Stamped> : public BasicBus<AnalogU16, N, Stamped> {
     public:
-        using InputRead::InputRead;
-        float read(bool inverse_read = false) override;
+        using BasicBus<AnalogU16, N, Stamped>::BasicBus;
+
+        template <size_t I>
+        float get();
+
+        template <size_t I>
+        uint16_t get_raw();
+
+        template <size_t I>
+        float get_voltage();
+
+        template <size_t I>
+        float get_fresh(std::chrono::microseconds max_age, bool inverse_read = false);
+
+        float operator [](size_t index);
+
+        uint16_t raw(size_t index) const {
+            return this->data[index];
+        }
     };
 
-    template<class T, size_t N>
-    class Bus : private NonCopyable<Bus<T, N>> {
+    template <size_t N, bool Stamped>
+    template <size_t I>
+    float Bus<AnalogU16, N, Stamped>::get() {
+        static_assert(I < N, OUT_OF_BOUNDS_ERROR);
+
+        return AnalogU16::to_float(this->data[I]);
+    }
+
+    template <size_t N, bool Stamped>
+    template <size_t I>
+    uint16_t Bus<AnalogU16, N, Stamped>::get_raw() {
+        static_assert(I < N, OUT_OF_BOUNDS_ERROR);
+
+        return this->data[I];
+    }
+
+    template <size_t N, bool Stamped>
+    template <size_t I>
+    float Bus<AnalogU16, N, Stamped>::get_voltage() {
+        static_assert(I < N, OUT_OF_BOUNDS_ERROR);
+
+        return AnalogU16::to_float(this->data[I]) * this->inputs[I]->get_reference_voltage();
+    }
+
+    template <size_t N, bool Stamped>
+    template <size_t I>
+    float Bus<AnalogU16, N, Stamped>::get_fresh(std::chrono::microseconds max_age, bool inverse_read) {
+        return AnalogU16::to_float(BasicBus<AnalogU16, N, Stamped>::template get_fresh<I>(max_age, inverse_read));
+    }
+
+    template <size_t N, bool Stamped>
+    float Bus<AnalogU16, N, Stamped>::operator [](size_t index) {
+        return AnalogU16::to_float(this->data[index]);
+    }
+
+    template <size_t N, bool Stamped = CACHED_BUS_TIMESTAMPS>
+    using ABus16 = Bus<AnalogU16, N, Stamped>;
+
+    // analog bus filled by a multi-channel ADC scan transferring straight into
+    // the cache. Dma is the target's scan engine and provides
+    //     void configure(const PinName *pins, size_t count, uint16_t *dest);
+    //     void start();        converts every channel in order into dest
+    //     bool busy() const;
+    // a scan completes behind the bus's back, so there is no set_stats; pass
+    // snapshot().values to a RunningStats<uint16_t, N>'s add_all instead
+    template <size_t N, class Dma>
+    class DmaABus : private NonCopyable<DmaABus<N, Dma>> {
     private:
-        T list[N];
+        uint16_t data[N];
+        uint16_t polarity;
+        uint16_t inverted[N];
+        SeqLock seq;
+        Timestamps<1> stamp;
+        uint16_t deadband;
+        Dma dma;
 
     public:
+        // raw samples
+        using snapshot_type = Snapshot<uint16_t, N>;
+
         template <class ...PT>
-        Bus(PT&& ...list);
+        DmaABus(PT ...pins);
 
-        template <size_t I>
-        auto get();
+        Dma &engine() {
+            return dma;
+        }
 
-        auto operator [](size_t index);
+        // triggers one scan of all channels and returns
+        void start(bool inverse_read = false);
+
+        bool ready() const {
+            return !dma.busy();
+        }
 
+        void wait() const {
+            while (dma.busy()) {}
+        }
+
+        // one scan, waiting for it to complete
         void read_all(bool inverse_read = false);
 
+        // also marks in changed the channels that moved by more than the deadband
+        void read_all(ChannelMask<N> &changed, bool inverse_read = false);
+
+        // in raw 16-bit steps
+        void set_deadband(uint16_t deadband) {
+            this->deadband = deadband;
+        }
+
+        // channels set in inverted are read inverted, inverse_read flips on top
+        void set_polarity(const ChannelMask<N> &inverted) {
+            for (size_t i = 0; i < N; ++i) {
+                this->inverted[i] = inverted.test(i) ? 0xFFFFU : 0U;
+            }
+        }
+
         template <size_t I>
-        void read(bool inverse_read = false);
+        float get();
 
-        template <size_t I, size_t In, size_t ...Index>
-        void read(bool inverse_read = false);
+        template <size_t I>
+        uint16_t get_raw();
 
-        void read(mstd::initializer_list<size_t> ids, bool inverse_read = false);
+        template <size_t I>
+        float get_voltage();
+
+        // cached value if the last scan started within max_age, otherwise a new scan
+        template <size_t I>
+        float get_fresh(std::chrono::microseconds max_age, bool inverse_read = false);
+
+        // start of the last scan, shared by all channels
+        template <size_t I>
+        uint32_t timestamp() const {
+            static_assert(I < N, OUT_OF_BOUNDS_ERROR);
+            return stamp.get(0);
+        }
+
+        float operator [](size_t index);
+
+        uint16_t raw(size_t index) const {
+            return data[index] ^ polarity ^ inverted[index];
+        }
+
+        // consistent cut of the last completed scan, retries while a scan is running
+        snapshot_type snapshot() const;
+
+        bool try_snapshot(snapshot_type &out) const;
     };
 
-    template <class In, class Data>
-    InputRead<In, Data>::InputRead(In &input) : input(input) {}
+    template <size_t N, class Dma>
+    template <class ...PT>
+    DmaABus<N, Dma>::DmaABus(PT ...pins) : data {}, polarity {0}, inverted {}, deadband {0} {
+        static_assert(sizeof...(PT) == N, "error: Bus needs one pin per channel");
 
-    template <class In, class Data>
-    InputRead<In, Data>::operator Data() {
-        return data;
+        const PinName names[N] = {pins...};
+        dma.configure(names, N, data);
     }
 
-    template <class T, size_t N>
-    template <class ...PT>
-    Bus<T, N>::Bus(PT&& ...list) : list {list...} {}
+    template <size_t N, class Dma>
+    void DmaABus<N, Dma>::start(bool inverse_read) {
+        wait();
+        // the write section covers the new polarity until the engine reports
+        // busy, from then on busy() covers the scan itself
+        seq.write_begin();
+        stamp.set(0, Timestamps<1>::now());
+        polarity = inverse_read ? 0xFFFFU : 0U;
+        dma.start();
+        seq.write_end();
+    }
 
-    template <class T, size_t N>
-    auto Bus<T, N>::operator [](size_t index) {
-        if (index >= N) {
-            #if __cpp_exceptions 
-            //    throw OUT_OF_BOUNDS_ERROR;
-            #endif
-        }
-        
-        return this->list[index].read_cached();
+    template <size_t N, class Dma>
+    void DmaABus<N, Dma>::read_all(bool inverse_read) {
+        start(inverse_read);
+        wait();
     }
 
-    template <class T, size_t N>
-    void Bus<T, N>::read_all(bool inverse_read) {
-        for (auto &in : list) {
-            in.read(inverse_read);
+    template <size_t N, class Dma>
+    void DmaABus<N, Dma>::read_all(ChannelMask<N> &changed, bool inverse_read) {
+        wait();
+        uint16_t before[N];
+        for (size_t i = 0; i < N; ++i) {
+            before[i] = raw(i);
+        }
+
+        read_all(inverse_read);
+
+        for (size_t w = 0; w < ChannelMask<N>::WORDS; ++w) {
+            uint32_t word = 0;
+            for (size_t b = 0; b < 32U && w * 32U + b < N; ++b) {
+                size_t i = w * 32U + b;
+                word |= static_cast<uint32_t>(exceeds(before[i], raw(i), deadband)) << b;
+            }
+            changed.words[w] = word;
         }
     }
 
-    template <class T, size_t N>
+    template <size_t N, class Dma>
     template <size_t I>
-    auto Bus<T, N>::get() {
+    float DmaABus<N, Dma>::get() {
         static_assert(I < N, OUT_OF_BOUNDS_ERROR);
 
-        return list[I].read_cached();
+        return AnalogU16::to_float(raw(I));
     }
 
-    template <class T, size_t N>
+    template <size_t N, class Dma>
     template <size_t I>
-    void Bus<T, N>::read(bool inverse_read) {
+    uint16_t DmaABus<N, Dma>::get_raw() {
         static_assert(I < N, OUT_OF_BOUNDS_ERROR);
-        this->list[I].read(inverse_read);
+
+        return raw(I);
     }
 
-    template <class T, size_t N>
-    template <size_t I, size_t In, size_t ...Index>
-    void Bus<T, N>::read(bool inverse_read) {
+    template <size_t N, class Dma>
+    template <size_t I>
+    float DmaABus<N, Dma>::get_voltage() {
         static_assert(I < N, OUT_OF_BOUNDS_ERROR);
-        this->list[I].read(inverse_read);
-        read<In, Index...>();
+
+        return AnalogU16::to_float(raw(I)) * MBED_CONF_TARGET_DEFAULT_ADC_VREF;
     }
 
-    template <class T, size_t N>
-    void Bus<T, N>::read(mstd::initializer_list<size_t> ids, bool inverse_read) {
-        for (auto id : ids) {
-            if (id >= N) {
-                #if __cpp_exceptions 
-                //    throw OUT_OF_BOUNDS_ERROR;
-                #endif
-            }
+    template <size_t N, class Dma>
+    template <size_t I>
+    float DmaABus<N, Dma>::get_fresh(std::chrono::microseconds max_age, bool inverse_read) {
+        static_assert(I < N, OUT_OF_BOUNDS_ERROR);
 
-            this->list[id].read(inverse_read);
+        if (!stamp.fresh(0, max_age)) {
+            read_all(inverse_read);
         }
+        return get<I>();
     }
 
-    template <size_t N>
-    using DBus = Bus<Digital, N>;
+    template <size_t N, class Dma>
+    float DmaABus<N, Dma>::operator [](size_t index) {
+        return AnalogU16::to_float(raw(index));
+    }
 
-    template <size_t N>
-    using ABus = Bus<Analog, N>;
+    template <size_t N, class Dma>
+    auto DmaABus<N, Dma>::snapshot() const -> snapshot_type {
+        snapshot_type out;
+        while (!try_snapshot(out)) {}
+        return out;
+    }
 
-    template <size_t N>
-    using void_if_non_nil = typename mstd::enable_if_t<N != 0, void>;
+    template <size_t N, class Dma>
+    bool DmaABus<N, Dma>::try_snapshot(snapshot_type &out) const {
+        uint32_t start = seq.read_begin();
+        if ((start & 1U) || dma.busy()) {
+            return false;
+        }
 
-    template <size_t N>
-    using void_if_nil = typename mstd::enable_if_t<N == 0, void>;
+        for (size_t i = 0; i < N; ++i) {
+            out.values[i] = raw(i);
+        }
+
+        return !dma.busy() && seq.read_valid(start);
+    }
 
     template <class T>
     struct assoc_data_type;
@@ -156,18 +2018,88 @@ namespace Cached {
     template <>
     struct assoc_data_type<Analog> : mstd::type_identity<float> {};
 
+    template <>
+    struct assoc_data_type<AnalogU16> : mstd::type_identity<uint16_t> {};
+
+    template <unsigned K>
+    struct assoc_data_type<AnalogAvg<K>> : mstd::type_identity<float> {};
+
+    template <class T>
+    struct assoc_data_type<Virtual<T>> : assoc_data_type<T> {};
+
+    template <class T>
+    struct assoc_data_type<Inverted<T>> : assoc_data_type<T> {};
+
+#if DEVICE_INTERRUPTIN
+    template <>
+    struct assoc_data_type<InterruptDigital> : mstd::type_identity<int> {};
+#endif
+
     template <class T>
     using assoc_data_type_t = typename assoc_data_type<mstd::remove_reference_t<T>>::type;
 
+    template <class ...T>
+    class VBus;
+
+    // read-only view of the cached values of a VBus, no values are copied.
+    // get<I>() references the cache itself, so later reads show through; use
+    // snapshot() when the bus is refreshed from another context.
+    //     auto [level, voltage] = bus.view();
+    template <class ...T>
+    class VBusView {
+    public:
+        explicit VBusView(const VBus<T...> &bus) : bus(&bus) {}
+
+        template <size_t I>
+        const auto &get() const {
+            static_assert(I < sizeof...(T), OUT_OF_BOUNDS_ERROR);
+            return mstd::get<I>(bus->list).cached();
+        }
+
+    private:
+        const VBus<T...> *bus;
+    };
+
     template<class ...T>
     class VBus {
+        friend class VBusView<T...>;
+
     private:
         mstd::tuple<T...> list;
         bool _inverse_read;
+        SeqLock seq;
+        float deadband;
+        Ema<sizeof...(T)> *ema;
+        ChannelMask<sizeof...(T)> polarity;
+        SampleHistory<float> *history;
+        ChannelStats<float> *stats;
 
         template <size_t I>
         using list_index_data = assoc_data_type_t<decltype(mstd::get<I>(list))>;
 
+        template <size_t I>
+        list_index_data<I> filter(list_index_data<I> value) {
+            return ema ? mstd::get<I>(list).cache(ema->update(I, value)) : value;
+        }
+
+        template <size_t I>
+        list_index_data<I> read_channel(bool inverse_read, uint32_t now) {
+            return filter<I>(mstd::get<I>(list).read(inverse_read ^ polarity.template test<I>(), now));
+        }
+
+        // the new cached values of channels Ids, gathered into one array after
+        // the reads so the bus only carries a single call each into history and stats
+        template <size_t ...Ids>
+        void record(uint32_t now, mstd::index_sequence<Ids...>) {
+            const float values[] = {static_cast<float>(mstd::get<Ids>(list).read_cached())...};
+            if constexpr (sizeof...(Ids) == sizeof...(T)) {
+                record_floats(history, stats, nullptr, values, sizeof...(Ids), now);
+            } else {
+                static constexpr size_t channels[] = {Ids...};
+                record_floats(history, stats, channels, values, sizeof...(Ids), now);
+            }
+        }
+
         template <size_t ...Ids>
         using bound_data_bus = mstd::tuple<assoc_data_type_t<decltype(mstd::get<Ids>(list))>...>;
 
@@ -185,9 +2117,19 @@ namespace Cached {
         VBus& operator =(VBus &&vbus) = default;
         
         using data_bus = mstd::tuple<assoc_data_type_t<T>...>;
+        using snapshot_type = data_bus;
 
         template <size_t I>
         auto get() -> list_index_data<I>;
+
+        // cached value if channel I was read within max_age, otherwise a new read
+        template <size_t I>
+        auto get_fresh(std::chrono::microseconds max_age) -> list_index_data<I>;
+
+        template <size_t I>
+        uint32_t timestamp() const {
+            return mstd::get<I>(list).timestamp();
+        }
         
         template <size_t I>
         auto read() -> list_index_data<I>;
@@ -195,22 +2137,72 @@ namespace Cached {
         template <size_t I>
         auto read(bool inverse_read) -> list_index_data<I>;
 
+        // each listed channel is read once, in index order, the result follows
+        // the order of the list
         template <size_t I, size_t In, size_t ...Index>
         bound_data_bus<I, In, Index...> read();
 
-        template <size_t ...Index>
-        bound_data_bus<Index...> read(bool inverse_read);
+        template <size_t I, size_t In, size_t ...Index>
+        bound_data_bus<I, In, Index...> read(bool inverse_read);
 
         data_bus read_all();
 
         data_bus read_all(bool inverse_read);
 
+        // also marks in changed the channels that moved by more than the deadband
+        data_bus read_all(ChannelMask<sizeof...(T)> &changed);
+
+        // fraction of full scale for analog channels, digital ones change on any flip
+        void set_deadband(float deadband) {
+            this->deadband = deadband;
+        }
+
+        // every read also low-pass filters the new values through ema before
+        // they enter the cache, which must outlive the bus. nullptr stops
+        void set_filter(Ema<sizeof...(T)> *ema) {
+            this->ema = ema;
+        }
+
+        // channels set in inverted are read inverted, the bus inverse_read flips
+        // on top. Inverted<T> elements fix the polarity at compile time instead
+        void set_polarity(const ChannelMask<sizeof...(T)> &inverted) {
+            polarity = inverted;
+        }
+
+        // every read also records the new cached values into history as floats,
+        // which must outlive the bus. nullptr stops
+        template <size_t K>
+        void set_history(History<float, sizeof...(T), K> *history) {
+            this->history = history;
+        }
+
+        void set_history(decltype(nullptr)) {
+            history = nullptr;
+        }
+
+        // every read also adds the new cached values to stats as floats, nullptr stops
+        void set_stats(RunningStats<float, sizeof...(T)> *stats) {
+            this->stats = stats;
+        }
+
         template <size_t ...Index, class ...DataArgs>
         void read(DataArgs &...dargs);
 
         template <class ...DataArgs>
         void read_all(DataArgs &... dargs);
 
+        using view_type = VBusView<T...>;
+
+        view_type view() const {
+            return view_type(*this);
+        }
+
+        // consistent cut of all cached values, retries while a refresh is in progress
+        data_bus snapshot() const;
+
+        // single attempt, false if a refresh was in progress
+        bool try_snapshot(data_bus &out) const;
+
         bool set_inverse_read(bool inverse_read) {
             bool _inv = this->_inverse_read;
             this->_inverse_read = inverse_read;
@@ -218,28 +2210,33 @@ namespace Cached {
         }
 
     private:
-        template <size_t I>
-        void_if_nil<I - 1U> read_all_iter(data_bus &data);
+        template <size_t ...Ids>
+        data_bus read_each(bool inverse_read, uint32_t now, mstd::index_sequence<Ids...>);
 
-        template <size_t I>
-        void_if_non_nil<I - 1U> read_all_iter(data_bus &data);
+        template <size_t ...Ids>
+        void read_planned(bool inverse_read, mstd::index_sequence<Ids...>);
 
-        template <class DBus, size_t I>
-        void read_iter(DBus &data);
+        template <size_t ...Ids>
+        void copy_cached(data_bus &out, mstd::index_sequence<Ids...>) const;
 
-        template <class DBus, size_t I, size_t In, size_t ...Index>
-        void read_iter(DBus &data);
+        template <size_t ...Ids>
+        void mark_changes(ChannelMask<sizeof...(T)> &changed, const data_bus &before,
+            const data_bus &now, mstd::index_sequence<Ids...>) const;
     };
 
     template <class ...T>
     template <class ...PT>
     VBus<T...>::VBus(PT &&...list) : 
-        list {list...}, _inverse_read {false} {}
+        list {list...}, _inverse_read {false}, deadband {0.0f}, ema {nullptr}, polarity {}, history {nullptr}, stats {nullptr} {
+        static_assert(all_lvalues<PT...>, DANGLING_INPUT_ERROR);
+    }
 
     template <class ...T>
     template <class ...PT>
     VBus<T...>::VBus(bool inverse_read, PT &&...list) : 
-        list {list...}, _inverse_read {inverse_read} {}
+        list {list...}, _inverse_read {inverse_read}, deadband {0.0f}, ema {nullptr}, polarity {}, history {nullptr}, stats {nullptr} {
+        static_assert(all_lvalues<PT...>, DANGLING_INPUT_ERROR);
+    }
 
     template <class ...T>
     template <size_t I>
@@ -249,47 +2246,57 @@ namespace Cached {
 
     template <class ...T>
     template <size_t I>
-    auto VBus<T...>::read() -> list_index_data<I> {
-        return mstd::get<I>(list).read(_inverse_read);
+    auto VBus<T...>::get_fresh(std::chrono::microseconds max_age) -> list_index_data<I> {
+        if (!mstd::get<I>(list).fresh(max_age)) {
+            return read<I>();
+        }
+        return mstd::get<I>(list).read_cached();
     }
 
     template <class ...T>
     template <size_t I>
-    auto VBus<T...>::read(bool inverse_read)-> list_index_data<I> {
-        bool _inv = set_inverse_read(inverse_read);
-        list_index_data<I> val = read<I>();
-        set_inverse_read(_inv);
-        return val;
+    auto VBus<T...>::read() -> list_index_data<I> {
+        return read<I>(static_cast<bool>(_inverse_read));
     }
 
     template <class ...T>
-    template <class DBus, size_t I>
-    void VBus<T...>::read_iter(DBus &data) {
-        mstd::get<0>(data) = read<I>();
+    template <size_t I>
+    auto VBus<T...>::read(bool inverse_read)-> list_index_data<I> {
+        seq.write_begin();
+        uint32_t now = Timestamps<1>::now();
+        list_index_data<I> val = read_channel<I>(inverse_read, now);
+        if (history || stats) {
+            record(now, mstd::index_sequence<I>());
+        }
+        seq.write_end();
+        return val;
     }
 
     template <class ...T>
-    template <class DBus, size_t I, size_t In, size_t ...Index>
-    void VBus<T...>::read_iter(DBus &data) {
-        auto read_val = mstd::get<I>(list).read();
-        mstd::get<sizeof...(Index) + 1U>(data) = read_val;
-        read_iter<DBus, In, Index...>(data);
+    template <size_t ...Ids>
+    void VBus<T...>::read_planned(bool inverse_read, mstd::index_sequence<Ids...>) {
+        static_assert(((Ids < sizeof...(T)) && ...), OUT_OF_BOUNDS_ERROR);
+
+        uint32_t now = Timestamps<1>::now();
+        (read_channel<Ids>(inverse_read, now), ...);
+        if (history || stats) {
+            record(now, mstd::index_sequence<Ids...>());
+        }
     }
 
     template <class ...T>
     template <size_t I, size_t In, size_t ...Index>
     auto VBus<T...>::read() -> bound_data_bus<I, In, Index...> {
-        bound_data_bus<I, In, Index...> dbus;
-        read_iter<decltype(dbus), I, In, Index...>(dbus);
-        return dbus;
+        return read<I, In, Index...>(static_cast<bool>(_inverse_read));
     }
 
     template <class ...T>
-    template <size_t ...Index>
-    auto VBus<T...>::read(bool inverse_read) -> bound_data_bus<Index...> {
-        bool _inv = set_inverse_read(inverse_read);
-        bound_data_bus<Index...> dbus = read<Index...>();
-        set_inverse_read(_inv);
+    template <size_t I, size_t In, size_t ...Index>
+    auto VBus<T...>::read(bool inverse_read) -> bound_data_bus<I, In, Index...> {
+        seq.write_begin();
+        read_planned(inverse_read, read_plan<I, In, Index...>());
+        bound_data_bus<I, In, Index...> dbus {get<I>(), get<In>(), get<Index>()...};
+        seq.write_end();
         return dbus;
     }
 
@@ -300,32 +2307,27 @@ namespace Cached {
     }
 
     template <class ...T>
-    template <size_t I>
-    void_if_nil<I - 1U> VBus<T...>::read_all_iter(data_bus &data) {
-        auto read_val = read<0>();
-        mstd::get<0>(data) = read_val;
-    }
-  
-    template <class ...T>
-    template <size_t I> 
-    void_if_non_nil<I - 1U> VBus<T...>::read_all_iter(data_bus &data) {
-        auto read_val = read<I>();
-        mstd::get<I>(data) = read_val;
-        read_all_iter<I - 1U>(data);
+    template <size_t ...Ids>
+    auto VBus<T...>::read_each(bool inverse_read, uint32_t now, mstd::index_sequence<Ids...>) -> data_bus {
+        data_bus dbus;
+        ((mstd::get<Ids>(dbus) = read_channel<Ids>(inverse_read, now)), ...);
+        return dbus;
     }
 
     template <class ...T>
     auto VBus<T...>::read_all() -> data_bus {
-        data_bus dbus;
-        read_all_iter<mstd::tuple_size<decltype(list)>::value - 1U>(dbus);
-        return dbus;
+        return read_all(_inverse_read);
     }
 
     template <class ...T>
     auto VBus<T...>::read_all(bool inverse_read) -> data_bus {
-        bool _inv = set_inverse_read(inverse_read);
-        data_bus dbus = read_all();
-        set_inverse_read(_inv);
+        seq.write_begin();
+        uint32_t now = Timestamps<1>::now();
+        data_bus dbus = read_each(inverse_read, now, mstd::index_sequence_for<T...>());
+        if (history || stats) {
+            record(now, mstd::index_sequence_for<T...>());
+        }
+        seq.write_end();
         return dbus;
     }
 
@@ -335,6 +2337,51 @@ namespace Cached {
         mstd::tie(dargs...) = read_all();
     }
 
+    template <class ...T>
+    auto VBus<T...>::read_all(ChannelMask<sizeof...(T)> &changed) -> data_bus {
+        data_bus before;
+        copy_cached(before, mstd::index_sequence_for<T...>());
+
+        data_bus now = read_all();
+
+        changed.clear();
+        mark_changes(changed, before, now, mstd::index_sequence_for<T...>());
+        return now;
+    }
+
+    template <class ...T>
+    template <size_t ...Ids>
+    void VBus<T...>::mark_changes(ChannelMask<sizeof...(T)> &changed, const data_bus &before,
+            const data_bus &now, mstd::index_sequence<Ids...>) const {
+        ((changed.words[Ids / 32U] |= static_cast<uint32_t>(exceeds(mstd::get<Ids>(before), mstd::get<Ids>(now),
+            scaled_deadband<mstd::tuple_element_t<Ids, data_bus>>(deadband))) << (Ids % 32U)), ...);
+    }
+
+    template <class ...T>
+    template <size_t ...Ids>
+    void VBus<T...>::copy_cached(data_bus &out, mstd::index_sequence<Ids...>) const {
+        ((mstd::get<Ids>(out) = mstd::get<Ids>(list).read_cached()), ...);
+    }
+
+    template <class ...T>
+    auto VBus<T...>::snapshot() const -> data_bus {
+        data_bus out;
+        while (!try_snapshot(out)) {}
+        return out;
+    }
+
+    template <class ...T>
+    bool VBus<T...>::try_snapshot(data_bus &out) const {
+        uint32_t start = seq.read_begin();
+        copy_cached(out, mstd::index_sequence_for<T...>());
+        return seq.read_valid(start);
+    }
+
+    template <size_t I, class ...T>
+    const auto &get(const VBusView<T...> &view) {
+        return view.template get<I>();
+    }
+
     template <class T>
     struct assoc_type;
 
@@ -344,13 +2391,97 @@ namespace Cached {
     template <>
     struct assoc_type<AnalogIn> : mstd::type_identity<Analog> {};
 
+#if DEVICE_INTERRUPTIN
+    template <>
+    struct assoc_type<InterruptIn> : mstd::type_identity<InterruptDigital> {};
+#endif
+
     template <class T>
     using assoc_type_t = typename assoc_type<T>::type;
 
     template <class ...Args>
-    VBus<assoc_type_t<Args>...> make_vbus(bool inverse_read = false, Args &&...args) {
-        return VBus<assoc_type_t<Args>...>(inverse_read, args...);
+    VBus<assoc_type_t<mstd::remove_reference_t<Args>>...> make_vbus(bool inverse_read = false, Args &&...args) {
+        static_assert(all_lvalues<Args...>, DANGLING_INPUT_ERROR);
+        return VBus<assoc_type_t<mstd::remove_reference_t<Args>>...>(inverse_read, args...);
     }
+
+    // inputs of an in-place bus, a base so they are built before the bus referencing them
+    template <class Inputs>
+    class InPlaceInputs {
+    protected:
+        template <class ...PT>
+        InPlaceInputs(PT ...names) : owned {names...} {}
+
+        Inputs owned;
+    };
+
+    // bus owning its inputs, built from pin names inside the bus object itself:
+    // no heap, no copies and nothing to outlive, e.g. InPlaceBus<Analog, 2> {PA_0, PA_1}
+    template <class T, size_t N, bool Stamped = CACHED_BUS_TIMESTAMPS>
+    class InPlaceBus : private InPlaceInputs<typename T::input_type[N]>, public Bus<T, N, Stamped> {
+    public:
+        template <class ...PT, if_pin_names<PT...> = 0>
+        InPlaceBus(PT ...names);
+
+    private:
+        template <size_t ...Ids, class ...PT>
+        InPlaceBus(mstd::index_sequence<Ids...>, PT ...names);
+    };
+
+    // VBus owning its inputs, e.g. InPlaceVBus<Digital, Analog> {PC_7, PA_0}
+    template <class ...T>
+    class InPlaceVBus : private InPlaceInputs<mstd::tuple<typename T::input_type...>>,
+        public VBus<T...>, private NonCopyable<InPlaceVBus<T...>> {
+    public:
+        template <class ...PT, if_pin_names<PT...> = 0>
+        InPlaceVBus(PT ...names);
+
+        template <class ...PT, if_pin_names<PT...> = 0>
+        InPlaceVBus(bool inverse_read, PT ...names);
+
+    private:
+        template <size_t ...Ids, class ...PT>
+        InPlaceVBus(mstd::index_sequence<Ids...>, bool inverse_read, PT ...names);
+    };
+
+    template <class T, size_t N, bool Stamped>
+    template <class ...PT, if_pin_names<PT...>>
+    InPlaceBus<T, N, Stamped>::InPlaceBus(PT ...names) : InPlaceBus(mstd::make_index_sequence<N>(), names...) {
+        static_assert(sizeof...(PT) == N, "error: Bus needs one pin per channel");
+    }
+
+    template <class T, size_t N, bool Stamped>
+    template <size_t ...Ids, class ...PT>
+    InPlaceBus<T, N, Stamped>::InPlaceBus(mstd::index_sequence<Ids...>, PT ...names) : 
+        InPlaceInputs<typename T::input_type[N]>(names...), Bus<T, N, Stamped>(this->owned[Ids]...) {}
+
+    template <class ...T>
+    template <class ...PT, if_pin_names<PT...>>
+    InPlaceVBus<T...>::InPlaceVBus(PT ...names) : InPlaceVBus(false, names...) {}
+
+    template <class ...T>
+    template <class ...PT, if_pin_names<PT...>>
+    InPlaceVBus<T...>::InPlaceVBus(bool inverse_read, PT ...names) : 
+        InPlaceVBus(mstd::index_sequence_for<T...>(), inverse_read, names...) {
+        static_assert(sizeof...(PT) == sizeof...(T), "error: Bus needs one pin per channel");
+    }
+
+    template <class ...T>
+    template <size_t ...Ids, class ...PT>
+    InPlaceVBus<T...>::InPlaceVBus(mstd::index_sequence<Ids...>, bool inverse_read, PT ...names) : 
+        InPlaceInputs<mstd::tuple<typename T::input_type...>>(names...),
+        VBus<T...>(inverse_read, mstd::get<Ids>(this->owned)...) {}
+}
+
+// structured bindings of a VBusView, each name references a cached value
+namespace std {
+    template <class ...T>
+    struct tuple_size<Cached::VBusView<T...>> : integral_constant<size_t, sizeof...(T)> {};
+
+    template <size_t I, class ...T>
+    struct tuple_element<I, Cached::VBusView<T...>> {
+        using type = const Cached::assoc_data_type_t<tuple_element_t<I, tuple<T...>>> &;
+    };
 }
 
 #endif // CACHE_BUS_H
\ No newline at end of file
@@ -0,0 +1,250 @@
+#ifndef CACHE_SAMPLER_H
+#define CACHE_SAMPLER_H
+
+#include "mbed.h"
+#include <chrono>
+#include <cstdint>
+#include <mstd_atomic>
+
+namespace Cached {
+    struct SamplerStats {
+        uint32_t samples;
+        uint32_t overruns;
+        uint32_t max_duration_us;
+        float rate_hz;
+        uint32_t dropped;   // refreshes the queue had no room for
+    };
+
+    // one queued refresh of a bus: the snapshot of its cache and when it started
+    template <class BusT>
+    struct BusSample {
+        uint32_t stamp;
+        typename BusT::snapshot_type values;
+    };
+
+    // lock-free single producer, single consumer ring of fixed-size records in
+    // storage provided by SampleQueue. the producer (e.g. a Ticker interrupt)
+    // fills claim()ed records, one consumer thread drains them. neither side
+    // blocks or disables interrupts; a record that finds the ring full is
+    // dropped and counted
+    template <class Record>
+    class RecordQueue : private NonCopyable<RecordQueue<Record>> {
+    public:
+        // producer: the next free record, nullptr (and one more overflow) if full
+        Record *claim();
+
+        // producer: publishes the record returned by the last claim()
+        void commit() {
+            head.store(head.load(mstd::memory_order_relaxed) + 1U, mstd::memory_order_release);
+        }
+
+        bool push(const Record &record);
+
+        // consumer: hands up to max records, oldest first, to consume(const Record &)
+        // in place and frees them together afterwards. returns how many
+        template <class F>
+        size_t drain(F &&consume, size_t max = SIZE_MAX);
+
+        bool pop(Record &out);
+
+        size_t size() const {
+            return head.load(mstd::memory_order_acquire) - tail.load(mstd::memory_order_acquire);
+        }
+
+        size_t capacity() const {
+            return mask + 1U;
+        }
+
+        // records dropped since the last take_overflows()
+        uint32_t overflows() const {
+            return dropped.load(mstd::memory_order_relaxed);
+        }
+
+        uint32_t take_overflows() {
+            return dropped.exchange(0, mstd::memory_order_relaxed);
+        }
+
+        // most records ever waiting at once
+        uint32_t high_water() const {
+            return peak.load(mstd::memory_order_relaxed);
+        }
+
+    protected:
+        RecordQueue(Record *records, size_t capacity) : 
+            records(records), mask(capacity - 1U), head {0}, tail {0}, dropped {0}, peak {0} {}
+
+    private:
+        Record *records;
+        uint32_t mask;
+        mstd::atomic<uint32_t> head;    // written by the producer only
+        mstd::atomic<uint32_t> tail;    // written by the consumer only
+        mstd::atomic<uint32_t> dropped;
+        mstd::atomic<uint32_t> peak;
+    };
+
+    // Capacity records, a power of two, e.g. SampleQueue<DBus<8>, 64>
+    template <class BusT, size_t Capacity>
+    class SampleQueue : public RecordQueue<BusSample<BusT>> {
+        static_assert(Capacity >= 2U && !(Capacity & (Capacity - 1U)), "error: queue capacity must be a power of two");
+
+    public:
+        SampleQueue() : RecordQueue<BusSample<BusT>>(storage, Capacity) {}
+
+    private:
+        BusSample<BusT> storage[Capacity];
+    };
+
+    template <class Record>
+    Record *RecordQueue<Record>::claim() {
+        uint32_t at = head.load(mstd::memory_order_relaxed);
+        uint32_t used = at - tail.load(mstd::memory_order_acquire);
+        if (used > mask) {
+            dropped.fetch_add(1U, mstd::memory_order_relaxed);
+            return nullptr;
+        }
+        if (used + 1U > peak.load(mstd::memory_order_relaxed)) {
+            peak.store(used + 1U, mstd::memory_order_relaxed);
+        }
+        return &records[at & mask];
+    }
+
+    template <class Record>
+    bool RecordQueue<Record>::push(const Record &record) {
+        Record *slot = claim();
+        if (!slot) {
+            return false;
+        }
+        *slot = record;
+        commit();
+        return true;
+    }
+
+    template <class Record>
+    template <class F>
+    size_t RecordQueue<Record>::drain(F &&consume, size_t max) {
+        uint32_t from = tail.load(mstd::memory_order_relaxed);
+        uint32_t ready = head.load(mstd::memory_order_acquire) - from;
+        size_t count = ready < max ? ready : max;
+        for (size_t i = 0; i < count; ++i) {
+            consume(static_cast<const Record &>(records[(from + i) & mask]));
+        }
+        tail.store(from + count, mstd::memory_order_release);
+        return count;
+    }
+
+    template <class Record>
+    bool RecordQueue<Record>::pop(Record &out) {
+        return drain([&out](const Record &record) { out = record; }, 1U) != 0;
+    }
+
+    // keeps the cache of any Bus or VBus fresh at a fixed rate, consumers only call get<I>().
+    // start() refreshes from a Ticker interrupt; AnalogIn locks a mutex on read, so analog
+    // buses should instead call sample() from an EventQueue::call_every or a thread loop.
+    // a refresh taking longer than the period, or starting while the previous one is
+    // still running, counts as an overrun
+    template <class BusT>
+    class Sampler : private NonCopyable<Sampler<BusT>> {
+    private:
+        BusT &bus;
+        std::chrono::microseconds period;
+        Ticker ticker;
+        RecordQueue<BusSample<BusT>> *queue;
+
+        mstd::atomic<bool> busy;
+        mstd::atomic<uint32_t> samples;
+        mstd::atomic<uint32_t> overruns;
+        mstd::atomic<uint32_t> max_duration;
+        mstd::atomic<uint32_t> first_start;
+        mstd::atomic<uint32_t> last_start;
+
+    public:
+        Sampler(BusT &bus, std::chrono::microseconds period);
+
+        ~Sampler() {
+            stop();
+        }
+
+        void start() {
+            ticker.attach([this] { sample(); }, period);
+        }
+
+        void stop() {
+            ticker.detach();
+        }
+
+        // one refresh of the bus, also the entry point for event queues and threads
+        void sample();
+
+        // every refresh also queues a snapshot of the bus, for a consumer that
+        // needs every sample rather than the latest. nullptr stops queueing
+        void set_queue(RecordQueue<BusSample<BusT>> *queue) {
+            this->queue = queue;
+        }
+
+        SamplerStats stats() const;
+
+        void reset_stats();
+    };
+
+    template <class BusT>
+    Sampler<BusT>::Sampler(BusT &bus, std::chrono::microseconds period) :
+        bus(bus), period(period), queue(nullptr), busy {false}, samples {0}, overruns {0},
+        max_duration {0}, first_start {0}, last_start {0} {}
+
+    template <class BusT>
+    void Sampler<BusT>::sample() {
+        if (busy.exchange(true, mstd::memory_order_acquire)) {
+            overruns.fetch_add(1U, mstd::memory_order_relaxed);
+            return;
+        }
+
+        uint32_t start = us_ticker_read();
+        bus.read_all();
+        if (queue) {
+            // straight into the queue, no intermediate copy
+            if (BusSample<BusT> *record = queue->claim()) {
+                record->stamp = start;
+                while (!bus.try_snapshot(record->values)) {}
+                queue->commit();
+            }
+        }
+        uint32_t duration = us_ticker_read() - start;
+
+        if (duration > static_cast<uint32_t>(period.count())) {
+            overruns.fetch_add(1U, mstd::memory_order_relaxed);
+        }
+        if (duration > max_duration.load(mstd::memory_order_relaxed)) {
+            max_duration.store(duration, mstd::memory_order_relaxed);
+        }
+        if (samples.load(mstd::memory_order_relaxed) == 0) {
+            first_start.store(start, mstd::memory_order_relaxed);
+        }
+        last_start.store(start, mstd::memory_order_relaxed);
+        samples.fetch_add(1U, mstd::memory_order_relaxed);
+
+        busy.store(false, mstd::memory_order_release);
+    }
+
+    template <class BusT>
+    SamplerStats Sampler<BusT>::stats() const {
+        SamplerStats stats;
+        stats.samples = samples.load(mstd::memory_order_relaxed);
+        stats.overruns = overruns.load(mstd::memory_order_relaxed);
+        stats.max_duration_us = max_duration.load(mstd::memory_order_relaxed);
+
+        uint32_t elapsed = last_start.load(mstd::memory_order_relaxed) -
+            first_start.load(mstd::memory_order_relaxed);
+        stats.rate_hz = stats.samples > 1U && elapsed ? (stats.samples - 1U) * 1e6f / elapsed : 0.0f;
+        stats.dropped = queue ? queue->overflows() : 0;
+        return stats;
+    }
+
+    template <class BusT>
+    void Sampler<BusT>::reset_stats() {
+        samples.store(0, mstd::memory_order_relaxed);
+        overruns.store(0, mstd::memory_order_relaxed);
+        max_duration.store(0, mstd::memory_order_relaxed);
+    }
+}
+
+#endif // CACHE_SAMPLER_H
@@ -2,6 +2,7 @@
 
 #include "mbed.h"
 #include "cache_bus.h"
+#include "cache_sampler.h"
 #include <tuple>
 
 DigitalIn pin1(PC_12);
@@ -16,25 +17,28 @@ AnalogIn pin8(PC_9);
 
 using namespace Cached;
 
-// variadic bus (aka mixed types)
-VBus<Digital, Digital, Analog, Digital, Analog, Digital> vbus {
+// variadic bus (aka mixed types), the inputs are built inside the bus from pin names
+InPlaceVBus<Digital, Digital, Analog, Digital, Analog, Digital> vbus {
     true,
-    DigitalIn(PC_7), 
-    DigitalIn(PC_8), 
-    AnalogIn(PC_9), 
-    DigitalIn(PC_10), 
-    AnalogIn(PC_11), 
-    DigitalIn(PC_12)
+    PC_7, 
+    PC_8, 
+    PC_9, 
+    PC_10, 
+    PC_11, 
+    PC_12
 }; 
 
-// handy helper
+// buttons cached from their edge interrupts next to a polled analog input
+InPlaceVBus<InterruptDigital, InterruptDigital, Analog> panel {PC_13, PC_14, PA_0};
+
+// handy helper, the bus references the inputs so they have to outlive it
 auto bus = make_vbus(
     true,
-    DigitalIn(PC_7), 
-    AnalogIn(PC_4),
-    DigitalIn(PC_8), 
-    DigitalIn(PC_10),
-    DigitalIn(PC_11) 
+    pin1, 
+    pin5,
+    pin2, 
+    pin3,
+    pin4 
 );
 
 int example_main()
@@ -42,11 +46,29 @@ int example_main()
     Digital digit {pin1};
 
     // equivalent to Cached::Bus<Cached::Digital, 4> {pin1 ... }
-    Cached::DBus<4> dbus {DigitalIn{PC_4}, pin2, pin3, pin4}; 
+    Cached::DBus<4> dbus {pin1, pin2, pin3, pin4}; 
+
+    // built from pin names the bus reads each GPIO port once per read_all
+    Cached::DBus<4> port_bus {PC_9, PC_10, PC_11, PC_12};
+    port_bus.set_debounce(true);    // buttons, levels settle after 4 agreeing reads
 
     // equivalent to Cached::Bus<Cached::Analog, 4> {pin5 ... }
     Cached::ABus<4> abus {pin5, pin6, pin7, pin8};
 
+    // caches raw 16-bit samples, float conversion only happens in get
+    Cached::ABus16<4> abus16 {pin5, pin6, pin7, pin8};
+
+    // owns its AnalogIn inputs, no globals to keep alive
+    Cached::InPlaceBus<Analog, 4> owned_abus {PA_0, PA_1, PA_4, PB_0};
+
+    // the last 16 values of every channel with their read times
+    static Cached::History<float, 4, 16> trend;
+    abus.set_history(&trend);
+
+    // min, max, mean and variance of every channel, kept while reading
+    static Cached::RunningStats<float, 4> telemetry;
+    abus.set_stats(&telemetry);
+
     digit.read();   //  updating cached value
     auto [l1, l2, l3, l4, l5, l6] = vbus.read_all(); // updating cached values for the hole bus
 
@@ -54,12 +76,30 @@ int example_main()
         //(updating cache only for pin1, pin3 and pin4)
         dbus.read<0, 2, 3>();   // compile-time bound checking 
         dbus.read_all();
+        port_bus.read_all();    // a single GPIOC read
 
         vbus.read_all();        // updating cached values
+        auto [w0, w1, w2, w3, w4, w5] = vbus.view();  // references into the cache, nothing copied
         bus.read_all();
 
         int d = dbus.get<3>();  // reads cached value (the value of pin2 is never updated)
+        uint8_t levels = dbus.as_integer();  // all four cached pins, pin1 in bit 0
         float a = abus.get<1>();
+        if (trend.size(1) > 1) {
+            float slope = (trend.value(1, 0) - trend.value(1, 1)) / (trend.stamp(1, 0) - trend.stamp(1, 1));
+        }
+        for (float v : trend.values_of(1, 0)) { /* oldest first, then values_of(1, 1) */ }
+        float spread = telemetry.max(1) - telemetry.min(1);
+        float noise = telemetry.variance(1);
+        telemetry.reset();      // next window
+        owned_abus.read_all();
+
+        panel.read_all();   // one ADC read, the buttons are already current
+        int pressed = panel.get<0>();
+
+        abus16.read_all();
+        uint16_t raw = abus16.get_raw<2>();
+        float volts = abus16.get_voltage<2>();
 
         int c0, c1, c2, c3, c4, c5;
         float t1;
@@ -79,6 +119,10 @@ int example_main()
 
         int d2 = digit;         // reads cached value for single entry
 
+        // reuses the cached value if it is at most 5 ms old, reads the pin otherwise
+        int d3 = dbus.get_fresh<1>(5ms);
+        uint32_t read_at = dbus.timestamp<1>();  // us_ticker time of that read
+
         // float a = abus[4];           // no bound checking, undefined behaviour
         // float a2 = abus.get<4>();    // compile time error: array index out of bound
     }
@@ -98,10 +142,65 @@ void calculate1(const Cached::DBus<4> &bus) {
 int example_main2()
 {
     Cached::DBus<4> dbus {pin1, pin2, pin3, pin4}; 
+    Cached::ChannelMask<4> changed;
     
     while (true) {
-        dbus.read_all();  // real read only once in a cycle 
+        dbus.read_all(changed);  // real read only once in a cycle 
+        if (!changed.any()) {
+            continue;   // nothing to recalculate
+        }
         calculate(dbus);
         calculate1(dbus); // using cached values many tymes
     }
-}
\ No newline at end of file
+}
+
+
+// background sampling, the cache is refreshed from a ticker interrupt every 1 ms
+
+int example_main3()
+{
+    Cached::DBus<4> dbus {PC_9, PC_10, PC_11, PC_12};
+    Cached::Sampler<Cached::DBus<4>> sampler {dbus, 1ms};
+
+    sampler.start();
+
+    while (true) {
+        calculate(dbus);  // only cached values, no reads here
+        calculate1(dbus);
+
+        // all four levels from the same refresh, even if the ticker fires meanwhile
+        auto levels = dbus.snapshot();
+        int l0 = levels.get<0>(), l3 = levels[3];
+
+        Cached::SamplerStats stats = sampler.stats();
+        if (stats.overruns) {
+            // sampling period too short for the bus
+        }
+    }
+}
+
+
+// every sample, not only the latest: the ticker queues a snapshot of each refresh
+// and a thread drains them in batches, neither side takes a lock
+
+Cached::SampleQueue<Cached::DBus<4>, 64> samples;
+
+int example_main4()
+{
+    Cached::DBus<4> dbus {PC_9, PC_10, PC_11, PC_12};
+    Cached::Sampler<Cached::DBus<4>> sampler {dbus, 1ms};
+
+    sampler.set_queue(&samples);
+    sampler.start();
+
+    while (true) {
+        ThisThread::sleep_for(10ms);
+        samples.drain([](const Cached::BusSample<Cached::DBus<4>> &sample) {
+            int level = sample.values.get<2>();     // level of PC_11 at sample.stamp
+        });
+
+        if (samples.take_overflows()) {
+            // the thread fell behind, refreshes were dropped
+        }
+    }
+}
@@ -0,0 +1,497 @@
+// microbenchmarks for the bus read and cache access paths on the host build
+//
+// usage: cached-bus-bench [case filter] [gpio latency ns] [adc latency ns]
+//
+// hw/op is the number of simulated GPIO register reads and ADC conversions per
+// operation
+
+#include "mbed.h"
+#include "cache_bus.h"
+#include "cache_sampler.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <utility>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace Cached;
+
+namespace {
+    constexpr size_t PIN_COUNT = 128;
+    constexpr size_t MAX_CHANNELS = 256;
+    constexpr size_t MAX_VBUS_CHANNELS = 64;
+
+    // read<I...> index packs are sorted and deduplicated at compile time
+    static_assert(mstd::is_same<read_plan<3, 1, 3, 0>, mstd::index_sequence<0, 1, 3>>::value,
+        "read plan not sorted or not deduplicated");
+    static_assert(mstd::is_same<read_plan<7, 7>, mstd::index_sequence<7>>::value,
+        "read plan not deduplicated");
+
+    const char *filter = nullptr;
+    volatile long sink;
+
+    class InstructionCounter {
+    public:
+        InstructionCounter() {
+    #if defined(__linux__)
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    #endif
+        }
+
+        ~InstructionCounter() {
+    #if defined(__linux__)
+            if (fd >= 0) {
+                close(fd);
+            }
+    #endif
+        }
+
+        bool available() const {
+            return fd >= 0;
+        }
+
+        void start() {
+    #if defined(__linux__)
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+    #endif
+        }
+
+        long long stop() {
+            long long count = 0;
+    #if defined(__linux__)
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+                if (::read(fd, &count, sizeof(count)) != sizeof(count)) {
+                    count = 0;
+                }
+            }
+    #endif
+            return count;
+        }
+
+    private:
+        int fd = -1;
+    };
+
+    InstructionCounter instructions;
+
+    // keeps the compiler from dropping stores to p
+    void escape(const void *p) {
+        asm volatile("" : : "g"(p) : "memory");
+    }
+
+    // runs op in batches until the timing is stable and reports the fastest batch
+    template <class Op>
+    void run(const char *name, size_t channels, Op &&op) {
+        if (filter && !strstr(name, filter)) {
+            return;
+        }
+
+        using clock = std::chrono::steady_clock;
+        constexpr int BATCHES = 15;
+
+        size_t iterations = 1;
+        for (;;) {
+            auto start = clock::now();
+            for (size_t i = 0; i < iterations; ++i) {
+                op();
+            }
+            if (clock::now() - start > std::chrono::milliseconds(2) || iterations >= (1U << 24)) {
+                break;
+            }
+            iterations *= 2;
+        }
+
+        double best_ns = 0;
+        long long best_instr = 0;
+        sim::reset_counters();
+        for (int b = 0; b < BATCHES; ++b) {
+            instructions.start();
+            auto start = clock::now();
+            for (size_t i = 0; i < iterations; ++i) {
+                op();
+            }
+            auto elapsed = clock::now() - start;
+            long long instr = instructions.stop();
+
+            double ns = std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+            if (b == 0 || ns < best_ns) {
+                best_ns = ns;
+            }
+            if (b == 0 || instr < best_instr) {
+                best_instr = instr;
+            }
+        }
+
+        double accesses = static_cast<double>(sim::gpio_reads() + sim::adc_conversions())
+            / (static_cast<double>(iterations) * BATCHES);
+
+        if (instructions.available()) {
+            printf("%-32s %4zu %10.2f %9.3f %9.2f %8.1f\n", name, channels, best_ns,
+                best_ns / channels, static_cast<double>(best_instr) / iterations / channels, accesses);
+        } else {
+            printf("%-32s %4zu %10.2f %9.3f %9s %8.1f\n", name, channels, best_ns,
+                best_ns / channels, "n/a", accesses);
+        }
+    }
+
+    DigitalIn *digital_pins[PIN_COUNT];
+    AnalogIn *analog_pins[PIN_COUNT];
+
+    DigitalIn &digital_pin(size_t i) {
+        return *digital_pins[i % PIN_COUNT];
+    }
+
+    AnalogIn &analog_pin(size_t i) {
+        return *analog_pins[i % PIN_COUNT];
+    }
+
+    PinName pin_name(size_t i) {
+        return static_cast<PinName>(i % PIN_COUNT);
+    }
+
+    template <size_t I>
+    using mixed_channel = mstd::conditional_t<I % 2U == 0, Digital, Analog>;
+
+    // the digital channels of mixed_channel cached from their edge interrupts
+    template <size_t I>
+    using interrupt_channel = mstd::conditional_t<I % 2U == 0, InterruptDigital, Analog>;
+
+    template <size_t I>
+    auto &mixed_pin() {
+        if constexpr (I % 2U == 0) {
+            return digital_pin(I);
+        } else {
+            return analog_pin(I);
+        }
+    }
+
+    template <class T, size_t N, class Pins, size_t ...I>
+    void bench_bus(const char *kind, Pins &&pin, mstd::index_sequence<I...>) {
+        Bus<T, N> bus {pin(I)...};
+        char name[64];
+
+        snprintf(name, sizeof(name), "%s::read_all", kind);
+        run(name, N, [&] { bus.read_all(); });
+
+        snprintf(name, sizeof(name), "%s::read<I...>", kind);
+        run(name, N, [&] { bus.template read<I...>(); });
+
+        // every channel listed twice, hw/op shows each is read only once
+        snprintf(name, sizeof(name), "%s::read<I...,I...>", kind);
+        run(name, N, [&] { bus.template read<I..., I...>(); });
+
+        snprintf(name, sizeof(name), "%s::read({ids})", kind);
+        run(name, N, [&] { bus.read({I...}); });
+
+        const auto all = ChannelMask<N>::of({I...});
+        snprintf(name, sizeof(name), "%s::read_mask", kind);
+        run(name, N, [&] { bus.read_mask(all); });
+
+        snprintf(name, sizeof(name), "%s::get<I>", kind);
+        run(name, N, [&] { sink = sink + (... + bus.template get<I>()); });
+
+        snprintf(name, sizeof(name), "%s::snapshot", kind);
+        run(name, N, [&] {
+            auto snapshot = bus.snapshot();
+            escape(&snapshot);
+        });
+
+        // full pass over the cached values, summed in their own type
+        snprintf(name, sizeof(name), "%s::scan", kind);
+        run(name, N, [&] {
+            mstd::decay_t<decltype(bus[0])> sum = 0;
+            for (size_t i = 0; i < N; ++i) {
+                sum += bus[i];
+            }
+            sink = sink + static_cast<long>(sum);
+        });
+
+        snprintf(name, sizeof(name), "%s::operator[]", kind);
+        run(name, N, [&] {
+            long sum = 0;
+            for (size_t i = 0; i < N; ++i) {
+                sum += bus[i];
+            }
+            sink = sink + sum;
+        });
+    }
+
+    template <size_t N, size_t ...I>
+    void bench_debounce(mstd::index_sequence<I...>) {
+        DBus<N> bus {digital_pin(I)...};
+        bus.set_debounce(true);
+        run("DBus(debounced)::read_all", N, [&] { bus.read_all(); });
+
+        DBus<N> port_bus {pin_name(I)...};
+        port_bus.set_debounce(true);
+        run("DBus(pins,debounced)::read_all", N, [&] { port_bus.read_all(); });
+    }
+
+    // 16x oversampling, averaging ABus floats in application code against AnalogAvg
+    template <size_t N, size_t ...I>
+    void bench_oversample(mstd::index_sequence<I...>) {
+        constexpr unsigned K = 16;
+
+        ABus<N> bus {analog_pin(I)...};
+        run("ABus x16 float average", N, [&] {
+            float sum[N] = {};
+            for (unsigned k = 0; k < K; ++k) {
+                bus.read_all();
+                ((sum[I] += bus.template get<I>()), ...);
+            }
+            ((sum[I] /= K), ...);
+            escape(sum);
+        });
+
+        ABusAvg<N, K> avg_bus {analog_pin(I)...};
+        run("ABusAvg<x16>::read_all", N, [&] { avg_bus.read_all(); });
+    }
+
+    template <size_t N, size_t ...I>
+    void bench_filter(mstd::index_sequence<I...>) {
+        static Ema<N> lowpass, lowpass16;
+        lowpass.set_shift(3);
+        lowpass16.set_shift(3);
+
+        ABus<N> bus {analog_pin(I)...};
+        bus.set_filter(&lowpass);
+        run("ABus(filtered)::read_all", N, [&] { bus.read_all(); });
+
+        ABus16<N> bus16 {analog_pin(I)...};
+        bus16.set_filter(&lowpass16);
+        run("ABus16(filtered)::read_all", N, [&] { bus16.read_all(); });
+    }
+
+    // last 32 samples per channel, copied out after read_all against recorded by the bus
+    template <size_t N, size_t ...I>
+    void bench_history(mstd::index_sequence<I...>) {
+        constexpr size_t K = 32;
+
+        ABus<N> bus {analog_pin(I)...};
+        static float copies[N][K];
+        static uint32_t stamps[N][K];
+        size_t next = 0;
+        run("ABus::read_all+copy", N, [&] {
+            bus.read_all();
+            ((copies[I][next] = bus.template get<I>()), ...);
+            ((stamps[I][next] = bus.template timestamp<I>()), ...);
+            next = (next + 1U) % K;
+            escape(copies);
+            escape(stamps);
+        });
+
+        static History<float, N, K> history;
+        bus.set_history(&history);
+        run("ABus(history)::read_all", N, [&] { bus.read_all(); });
+    }
+
+    // running statistics kept while the values enter the cache
+    template <size_t N, size_t ...I>
+    void bench_stats(mstd::index_sequence<I...>) {
+        ABus<N> bus {analog_pin(I)...};
+        static RunningStats<float, N> stats;
+        bus.set_stats(&stats);
+        run("ABus(stats)::read_all", N, [&] { bus.read_all(); });
+
+        VBus<mixed_channel<I>...> vbus {mixed_pin<I>()...};
+        static RunningStats<float, N> vstats;
+        vbus.set_stats(&vstats);
+        run("VBus(stats)::read_all", N, [&] { vbus.read_all(); });
+    }
+
+    // every refresh handed to a consumer, through the lock-free queue and through
+    // a mutex guarded ring as a baseline. drained in the same thread, uncontended
+    template <size_t N, size_t ...I>
+    void bench_queue(mstd::index_sequence<I...>) {
+        using Bus16 = ABus16<N>;
+        constexpr size_t DEPTH = 16;
+
+        Bus16 bus {analog_pin(I)...};
+        Sampler<Bus16> sampler {bus, 1ms};
+        run("Sampler::sample", N, [&] { sampler.sample(); });
+
+        static SampleQueue<Bus16, DEPTH> queue;
+        sampler.set_queue(&queue);
+        run("Sampler(queue)::sample+drain", N, [&] {
+            sampler.sample();
+            queue.drain([](const BusSample<Bus16> &record) { escape(&record); });
+        });
+        sampler.set_queue(nullptr);
+
+        static BusSample<Bus16> ring[DEPTH];
+        static size_t head = 0, tail = 0;
+        std::mutex lock;
+        run("mutex queue sample+drain", N, [&] {
+            sampler.sample();
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                if (head - tail < DEPTH) {
+                    ring[head % DEPTH].values = bus.snapshot();
+                    ++head;
+                }
+            }
+            std::lock_guard<std::mutex> guard(lock);
+            for (; tail != head; ++tail) {
+                escape(&ring[tail % DEPTH]);
+            }
+        });
+    }
+
+    template <size_t N, size_t ...I>
+    void bench_vbus(mstd::index_sequence<I...>) {
+        VBus<mixed_channel<I>...> bus {mixed_pin<I>()...};
+
+        run("VBus::read_all", N, [&] { bus.read_all(); });
+        run("VBus::read<I...>", N, [&] {
+            auto values = bus.template read<I...>();
+            escape(&values);
+        });
+        run("VBus::read<I...,I...>", N, [&] {
+            auto values = bus.template read<I..., I...>();
+            escape(&values);
+        });
+        run("VBus::get<I>", N, [&] { sink = sink + (... + bus.template get<I>()); });
+        run("VBus::view", N, [&] {
+            auto view = bus.view();
+            sink = sink + (... + view.template get<I>());
+        });
+        run("VBus::snapshot", N, [&] {
+            auto snapshot = bus.snapshot();
+            escape(&snapshot);
+        });
+    }
+
+    // inputs built inside the bus, against ABus and VBus over the global inputs
+    template <size_t N, size_t ...I>
+    void bench_in_place(mstd::index_sequence<I...>) {
+        InPlaceBus<Analog, N> bus {pin_name(I)...};
+        run("InPlaceBus<Analog>::read_all", N, [&] { bus.read_all(); });
+
+        InPlaceVBus<mixed_channel<I>...> vbus {pin_name(I)...};
+        run("InPlaceVBus::read_all", N, [&] { vbus.read_all(); });
+
+        InPlaceVBus<interrupt_channel<I>...> irq_vbus {pin_name(I)...};
+        run("InPlaceVBus(irq)::read_all", N, [&] { irq_vbus.read_all(); });
+    }
+
+    template <size_t N, size_t ...I>
+    void bench_dma_bus(mstd::index_sequence<I...>) {
+        DmaABus<N, sim::AdcDma> bus {pin_name(I)...};
+
+        run("DmaABus::read_all", N, [&] { bus.read_all(); });
+        run("DmaABus::get<I>", N, [&] { sink = sink + (... + bus.template get<I>()); });
+        run("DmaABus::snapshot", N, [&] {
+            auto snapshot = bus.snapshot();
+            escape(&snapshot);
+        });
+    }
+
+    template <class T, class Ref, size_t N>
+    void bench_input_read(const char *kind) {
+        static_assert(N <= PIN_COUNT, "one element per pin");
+
+        alignas(T) unsigned char storage[N][sizeof(T)];
+        Ref *list[N];
+        for (size_t i = 0; i < N; ++i) {
+            list[i] = new (storage[i]) T(digital_pin(i));
+        }
+
+        char name[64];
+
+        snprintf(name, sizeof(name), "%s::read", kind);
+        run(name, N, [&] {
+            for (auto in : list) {
+                in->read(false);
+            }
+        });
+
+        snprintf(name, sizeof(name), "%s::read_cached", kind);
+        run(name, N, [&] {
+            long sum = 0;
+            for (auto in : list) {
+                sum += in->read_cached();
+            }
+            sink = sink + sum;
+        });
+
+        for (auto in : list) {
+            static_cast<T *>(in)->~T();
+        }
+    }
+
+    template <size_t N>
+    void bench_size() {
+        bench_bus<Digital, N>("DBus", digital_pin, mstd::make_index_sequence<N>());
+        bench_bus<Digital, N>("DBus(pins)", pin_name, mstd::make_index_sequence<N>());
+        bench_debounce<N>(mstd::make_index_sequence<N>());
+        bench_bus<Analog, N>("ABus", analog_pin, mstd::make_index_sequence<N>());
+        bench_bus<AnalogU16, N>("ABus16", analog_pin, mstd::make_index_sequence<N>());
+        bench_dma_bus<N>(mstd::make_index_sequence<N>());
+        bench_oversample<N>(mstd::make_index_sequence<N>());
+        bench_filter<N>(mstd::make_index_sequence<N>());
+        bench_history<N>(mstd::make_index_sequence<N>());
+        bench_queue<N>(mstd::make_index_sequence<N>());
+        // a VBus or InPlaceBus this wide takes minutes to compile and adds
+        // nothing per channel
+        if constexpr (N <= MAX_VBUS_CHANNELS) {
+            bench_stats<N>(mstd::make_index_sequence<N>());
+            bench_vbus<N>(mstd::make_index_sequence<N>());
+            bench_in_place<N>(mstd::make_index_sequence<N>());
+        }
+        if constexpr (N <= PIN_COUNT) {
+            bench_input_read<Digital, Digital, N>("Digital");
+            bench_input_read<Virtual<Digital>, InputRead<DigitalIn, int>, N>("Virtual<Digital>");
+        }
+    }
+
+    template <size_t ...N>
+    void bench_sizes(mstd::index_sequence<N...>) {
+        (bench_size<N>(), ...);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "all") != 0) {
+        filter = argv[1];
+    }
+    if (argc > 2) {
+        sim::set_gpio_latency(std::chrono::nanoseconds(atol(argv[2])));
+    }
+    if (argc > 3) {
+        sim::set_adc_latency(std::chrono::nanoseconds(atol(argv[3])));
+    }
+
+    alignas(DigitalIn) static unsigned char digital_storage[PIN_COUNT][sizeof(DigitalIn)];
+    alignas(AnalogIn) static unsigned char analog_storage[PIN_COUNT][sizeof(AnalogIn)];
+    for (size_t i = 0; i < PIN_COUNT; ++i) {
+        PinName pin = static_cast<PinName>(i);
+        digital_pins[i] = new (digital_storage[i]) DigitalIn(pin);
+        analog_pins[i] = new (analog_storage[i]) AnalogIn(pin);
+        sim::set(pin, i % 3U ? 0xFFFF : 0);
+    }
+
+    printf("%-32s %4s %10s %9s %9s %8s\n", "case", "N", "ns/op", "ns/ch", "instr/ch", "hw/op");
+    bench_sizes(mstd::index_sequence<1, 2, 4, 8, 16, 32, 64, 128, MAX_CHANNELS>());
+
+    return 0;
+}
@@ -0,0 +1,26 @@
+// VBus read paths of an 8 channel bus, built with -Os like the mbed release
+// profile. `cmake --build <dir> --target cached-bus-codesize` lists the size
+// of each instantiated function
+
+#include "mbed.h"
+#include "cache_bus.h"
+
+using namespace Cached;
+
+using VBus8 = VBus<Digital, Analog, Digital, Analog, Digital, Analog, Digital, Analog>;
+
+VBus8::data_bus vbus8_read_all(VBus8 &bus) {
+    return bus.read_all();
+}
+
+VBus8::data_bus vbus8_read_all_inverse(VBus8 &bus) {
+    return bus.read_all(true);
+}
+
+auto vbus8_read_low(VBus8 &bus) {
+    return bus.read<0, 1, 2, 3>();
+}
+
+auto vbus8_read_odd(VBus8 &bus) {
+    return bus.read<7, 5, 3, 1>(true);
+}
@@ -0,0 +1 @@
+#include "examples.h"
@@ -0,0 +1,369 @@
+#include "mbed.h"
+#include "hal_sim.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mbed {
+    namespace sim {
+        namespace {
+            constexpr size_t PIN_COUNT = PortCount * 16U;
+
+            struct Pin {
+                std::atomic<uint16_t> value {0};
+                std::atomic<bool> scripted {false};
+                std::vector<uint16_t> script;
+                size_t cursor = 0;
+                irq_handler handler = nullptr;
+                uintptr_t context = 0;
+            };
+
+            Pin pins[PIN_COUNT];
+            std::mutex script_lock;
+
+            std::atomic<int64_t> gpio_latency_ns {0};
+            std::atomic<int64_t> adc_latency_ns {0};
+            std::atomic<uint32_t> gpio_count {0};
+            std::atomic<uint32_t> adc_count {0};
+
+            Pin &pin_state(PinName pin) {
+                size_t index = STM_PORT(pin) * 16U + STM_PIN(pin);
+                return pins[index < PIN_COUNT ? index : 0];
+            }
+
+            void stall(const std::atomic<int64_t> &latency) {
+                int64_t ns = latency.load(std::memory_order_relaxed);
+                if (ns <= 0) {
+                    return;
+                }
+
+                auto until = std::chrono::steady_clock::now() + std::chrono::nanoseconds(ns);
+                while (std::chrono::steady_clock::now() < until) {}
+            }
+
+            // counters are only diagnostic, a plain load and store keeps the
+            // simulated access cheap compared to a locked increment
+            void count(std::atomic<uint32_t> &counter) {
+                counter.store(counter.load(std::memory_order_relaxed) + 1U, std::memory_order_relaxed);
+            }
+
+            uint16_t sample(Pin &state) {
+                if (!state.scripted.load(std::memory_order_acquire)) {
+                    return state.value.load(std::memory_order_relaxed);
+                }
+
+                std::lock_guard<std::mutex> guard(script_lock);
+                if (state.script.empty()) {
+                    return state.value.load(std::memory_order_relaxed);
+                }
+
+                uint16_t value = state.script[state.cursor];
+                state.cursor = (state.cursor + 1U) % state.script.size();
+                state.value.store(value, std::memory_order_relaxed);
+                return value;
+            }
+        }
+
+        void set(PinName pin, uint16_t value) {
+            Pin &state = pin_state(pin);
+            std::lock_guard<std::mutex> guard(script_lock);
+            state.scripted.store(false, std::memory_order_release);
+            state.script.clear();
+            state.value.store(value, std::memory_order_relaxed);
+        }
+
+        void edge(PinName pin, uint16_t value) {
+            Pin &state = pin_state(pin);
+            irq_handler handler;
+            uintptr_t context;
+            bool flipped;
+            {
+                std::lock_guard<std::mutex> guard(script_lock);
+                state.scripted.store(false, std::memory_order_release);
+                state.script.clear();
+                flipped = (state.value.exchange(value, std::memory_order_relaxed) != 0) != (value != 0);
+                handler = state.handler;
+                context = state.context;
+            }
+
+            // outside the lock, the handler may read pins
+            if (flipped && handler) {
+                handler(context, value != 0);
+            }
+        }
+
+        void irq_init(PinName pin, irq_handler handler, uintptr_t context) {
+            Pin &state = pin_state(pin);
+            std::lock_guard<std::mutex> guard(script_lock);
+            state.handler = handler;
+            state.context = context;
+        }
+
+        void irq_free(PinName pin) {
+            irq_init(pin, nullptr, 0);
+        }
+
+        uint16_t peek(PinName pin) {
+            return pin_state(pin).value.load(std::memory_order_relaxed);
+        }
+
+        void script(PinName pin, std::initializer_list<uint16_t> values) {
+            script(pin, values.begin(), values.size());
+        }
+
+        void script(PinName pin, const uint16_t *values, size_t count) {
+            Pin &state = pin_state(pin);
+            std::lock_guard<std::mutex> guard(script_lock);
+            state.script.assign(values, values + count);
+            state.cursor = 0;
+            state.scripted.store(count != 0, std::memory_order_release);
+        }
+
+        void set_gpio_latency(std::chrono::nanoseconds latency) {
+            gpio_latency_ns.store(latency.count(), std::memory_order_relaxed);
+        }
+
+        void set_adc_latency(std::chrono::nanoseconds latency) {
+            adc_latency_ns.store(latency.count(), std::memory_order_relaxed);
+        }
+
+        uint32_t gpio_reads() {
+            return gpio_count.load(std::memory_order_relaxed);
+        }
+
+        uint32_t adc_conversions() {
+            return adc_count.load(std::memory_order_relaxed);
+        }
+
+        void reset_counters() {
+            gpio_count.store(0, std::memory_order_relaxed);
+            adc_count.store(0, std::memory_order_relaxed);
+        }
+
+        void reset() {
+            {
+                std::lock_guard<std::mutex> guard(script_lock);
+                for (auto &state : pins) {
+                    state.scripted.store(false, std::memory_order_release);
+                    state.script.clear();
+                    state.cursor = 0;
+                    state.value.store(0, std::memory_order_relaxed);
+                }
+            }
+
+            set_gpio_latency(std::chrono::nanoseconds(0));
+            set_adc_latency(std::chrono::nanoseconds(0));
+            reset_counters();
+        }
+
+        int gpio_read(PinName pin) {
+            count(gpio_count);
+            stall(gpio_latency_ns);
+            return sample(pin_state(pin)) != 0;
+        }
+
+        uint32_t port_read(PortName port, uint32_t mask) {
+            count(gpio_count);
+            stall(gpio_latency_ns);
+
+            uint32_t value = 0;
+            for (uint32_t bit = 0; bit < 16U; ++bit) {
+                if (mask & (1U << bit)) {
+                    PinName pin = static_cast<PinName>((port << 4) | bit);
+                    value |= static_cast<uint32_t>(sample(pin_state(pin)) != 0) << bit;
+                }
+            }
+            return value;
+        }
+
+        uint16_t adc_read(PinName pin) {
+            count(adc_count);
+            stall(adc_latency_ns);
+            return sample(pin_state(pin));
+        }
+
+        struct AdcDma::State {
+            std::vector<PinName> pins;
+            uint16_t *dest = nullptr;
+            std::atomic<bool> busy {false};
+            bool triggered = false;
+            bool stopping = false;
+            std::mutex lock;
+            std::condition_variable wake;
+            std::thread worker;
+
+            void run() {
+                std::unique_lock<std::mutex> guard(lock);
+                for (;;) {
+                    wake.wait(guard, [this] { return triggered || stopping; });
+                    if (stopping) {
+                        return;
+                    }
+                    triggered = false;
+
+                    for (size_t i = 0; i < pins.size(); ++i) {
+                        dest[i] = adc_read(pins[i]);
+                    }
+                    busy.store(false, std::memory_order_release);
+                }
+            }
+        };
+
+        AdcDma::AdcDma() : state(new State) {
+            State *dma = state;
+            state->worker = std::thread([dma] { dma->run(); });
+        }
+
+        AdcDma::~AdcDma() {
+            {
+                std::lock_guard<std::mutex> guard(state->lock);
+                state->stopping = true;
+            }
+            state->wake.notify_one();
+            state->worker.join();
+            delete state;
+        }
+
+        void AdcDma::configure(const PinName *pins, size_t count, uint16_t *dest) {
+            std::lock_guard<std::mutex> guard(state->lock);
+            state->pins.assign(pins, pins + count);
+            state->dest = dest;
+        }
+
+        void AdcDma::start() {
+            state->busy.store(true, std::memory_order_relaxed);
+            {
+                std::lock_guard<std::mutex> guard(state->lock);
+                state->triggered = true;
+            }
+            state->wake.notify_one();
+        }
+
+        bool AdcDma::busy() const {
+            return state->busy.load(std::memory_order_acquire);
+        }
+    }
+}
+
+void mbed_error(int error_status, const char *error_msg, uint32_t error_value,
+        const char *filename, int line_number) {
+    fprintf(stderr, "mbed error 0x%X: %s (value 0x%X, %s:%d)\n", static_cast<unsigned>(error_status),
+        error_msg, static_cast<unsigned>(error_value), filename, line_number);
+    abort();
+}
+
+PinName port_pin(PortName port, int pin_n) {
+    return static_cast<PinName>((port << 4) | pin_n);
+}
+
+uint32_t us_ticker_read() {
+    static const auto epoch = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::steady_clock::now() - epoch;
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+}
+
+namespace rtos {
+    namespace ThisThread {
+        void sleep_for(std::chrono::milliseconds rel_time) {
+            std::this_thread::sleep_for(rel_time);
+        }
+    }
+}
+
+namespace mbed {
+    InterruptIn::InterruptIn(PinName pin) : InterruptIn(pin, PullDefault) {}
+
+    InterruptIn::InterruptIn(PinName pin, PinMode mode) : _pin(pin), _mode(mode), _enabled(true) {
+        sim::irq_init(pin, &InterruptIn::irq, reinterpret_cast<uintptr_t>(this));
+    }
+
+    InterruptIn::~InterruptIn() {
+        sim::irq_free(_pin);
+    }
+
+    void InterruptIn::rise(Callback<void()> func) {
+        disable_irq();
+        _rise = std::move(func);
+        enable_irq();
+    }
+
+    void InterruptIn::fall(Callback<void()> func) {
+        disable_irq();
+        _fall = std::move(func);
+        enable_irq();
+    }
+
+    void InterruptIn::enable_irq() {
+        _enabled.store(true, std::memory_order_release);
+    }
+
+    void InterruptIn::disable_irq() {
+        _enabled.store(false, std::memory_order_release);
+    }
+
+    void InterruptIn::irq(uintptr_t context, int rising) {
+        InterruptIn *in = reinterpret_cast<InterruptIn *>(context);
+        if (!in->_enabled.load(std::memory_order_acquire)) {
+            return;
+        }
+
+        Callback<void()> &func = rising ? in->_rise : in->_fall;
+        if (func) {
+            func();
+        }
+    }
+
+    struct Ticker::State {
+        Callback<void()> func;
+        std::chrono::microseconds period {0};
+        bool stopping = false;
+        std::mutex lock;
+        std::condition_variable wake;
+        std::thread worker;
+
+        void run() {
+            auto next = std::chrono::steady_clock::now() + period;
+            std::unique_lock<std::mutex> guard(lock);
+            while (!wake.wait_until(guard, next, [this] { return stopping; })) {
+                guard.unlock();
+                func();
+                guard.lock();
+                next += period;
+            }
+        }
+    };
+
+    Ticker::Ticker() : state(nullptr) {}
+
+    Ticker::~Ticker() {
+        detach();
+    }
+
+    void Ticker::attach(Callback<void()> func, std::chrono::microseconds t) {
+        detach();
+        state = new State;
+        state->func = std::move(func);
+        state->period = t;
+        State *ticker = state;
+        state->worker = std::thread([ticker] { ticker->run(); });
+    }
+
+    void Ticker::detach() {
+        if (!state) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(state->lock);
+            state->stopping = true;
+        }
+        state->wake.notify_one();
+        state->worker.join();
+        delete state;
+        state = nullptr;
+    }
+}
@@ -0,0 +1,52 @@
+// host stand-in for the target PinNames.h, laid out like the STM32 targets:
+// bits [7:4] select the port, bits [3:0] the pin within it
+
+#ifndef MBED_PINNAMES_H
+#define MBED_PINNAMES_H
+
+#include <cstdint>
+
+#define STM_PORT(X) (((uint32_t)(X) >> 4) & 0xF)
+#define STM_PIN(X)  ((uint32_t)(X) & 0xF)
+
+#define SIM_PORT_PINS(P, N) \
+    P##_0 = (N) << 4, P##_1, P##_2, P##_3, P##_4, P##_5, P##_6, P##_7, \
+    P##_8, P##_9, P##_10, P##_11, P##_12, P##_13, P##_14, P##_15
+
+typedef enum {
+    PortA = 0,
+    PortB = 1,
+    PortC = 2,
+    PortD = 3,
+    PortE = 4,
+    PortF = 5,
+    PortG = 6,
+    PortH = 7,
+    PortCount
+} PortName;
+
+typedef enum {
+    SIM_PORT_PINS(PA, 0),
+    SIM_PORT_PINS(PB, 1),
+    SIM_PORT_PINS(PC, 2),
+    SIM_PORT_PINS(PD, 3),
+    SIM_PORT_PINS(PE, 4),
+    SIM_PORT_PINS(PF, 5),
+    SIM_PORT_PINS(PG, 6),
+    SIM_PORT_PINS(PH, 7),
+
+    LED1 = PC_13,
+    NC = (int)0xFFFFFFFF
+} PinName;
+
+#undef SIM_PORT_PINS
+
+typedef enum {
+    PullNone = 0,
+    PullUp = 1,
+    PullDown = 2,
+    OpenDrain = 3,
+    PullDefault = PullNone
+} PinMode;
+
+#endif // MBED_PINNAMES_H
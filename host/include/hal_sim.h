@@ -0,0 +1,74 @@
+// simulated pin and peripheral state behind the host mbed stand-in
+
+#ifndef HAL_SIM_H
+#define HAL_SIM_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include "PinNames.h"
+
+namespace mbed {
+    namespace sim {
+        // value returned by the next reads of pin, digital reads treat non-zero as high
+        void set(PinName pin, uint16_t value);
+
+        // current value of pin, not counted as a read
+        uint16_t peek(PinName pin);
+
+        // sets pin like set() and, when its digital level flips, runs the pin
+        // interrupt handler in the calling thread as the ISR would
+        void edge(PinName pin, uint16_t value);
+
+        // values returned by successive reads of pin, repeated cyclically
+        void script(PinName pin, std::initializer_list<uint16_t> values);
+        void script(PinName pin, const uint16_t *values, size_t count);
+
+        // cost of a single GPIO register read and of a single ADC conversion
+        void set_gpio_latency(std::chrono::nanoseconds latency);
+        void set_adc_latency(std::chrono::nanoseconds latency);
+
+        // hardware accesses performed since the last reset
+        uint32_t gpio_reads();
+        uint32_t adc_conversions();
+        void reset_counters();
+
+        // all pins low, no scripts, no latency, counters cleared
+        void reset();
+
+        // multi-channel ADC scan into memory, converting on a background thread
+        // like a DMA transfer, each conversion costs the configured ADC latency
+        class AdcDma {
+        public:
+            AdcDma();
+            ~AdcDma();
+
+            AdcDma(const AdcDma &) = delete;
+            AdcDma& operator =(const AdcDma &) = delete;
+
+            void configure(const PinName *pins, size_t count, uint16_t *dest);
+
+            // converts every configured channel in order into dest
+            void start();
+
+            bool busy() const;
+
+        private:
+            struct State;
+            State *state;
+        };
+
+        // driver side, counted and delayed like real accesses
+        int gpio_read(PinName pin);
+        uint32_t port_read(PortName port, uint32_t mask);
+        uint16_t adc_read(PinName pin);
+
+        // one edge handler per pin, rising is 1 on a low to high edge
+        using irq_handler = void (*)(uintptr_t context, int rising);
+        void irq_init(PinName pin, irq_handler handler, uintptr_t context);
+        void irq_free(PinName pin);
+    }
+}
+
+#endif // HAL_SIM_H
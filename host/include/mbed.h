@@ -0,0 +1,201 @@
+// host stand-in for mbed.h, provides just enough of the mbed-os drivers for
+// the cached bus templates to build and run on the development machine
+
+#ifndef MBED_H
+#define MBED_H
+
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <functional>
+#include "PinNames.h"
+#include "hal_sim.h"
+
+#define MBED_ASSERT(expr) assert(expr)
+
+// fatal errors print the message and abort, like the halt on the target
+#define MBED_MODULE_DRIVER_GPIO 0x0B
+#define MBED_ERROR_CODE_INVALID_ARGUMENT 0x01
+#define MBED_MAKE_ERROR(module, error_code) (((module) << 16) | (error_code))
+#define MBED_ERROR(error_status, error_msg) mbed_error(error_status, error_msg, 0, __FILE__, __LINE__)
+
+[[noreturn]] void mbed_error(int error_status, const char *error_msg, uint32_t error_value,
+    const char *filename, int line_number);
+
+PinName port_pin(PortName port, int pin_n);
+
+uint32_t us_ticker_read();
+
+#define DEVICE_PORTIN 1
+#define DEVICE_INTERRUPTIN 1
+
+#ifndef MBED_CONF_TARGET_DEFAULT_ADC_VREF
+#define MBED_CONF_TARGET_DEFAULT_ADC_VREF 3.3f
+#endif
+
+namespace mbed {
+    template <typename Signature>
+    using Callback = std::function<Signature>;
+
+    template <typename T>
+    class NonCopyable {
+    protected:
+        NonCopyable() = default;
+        ~NonCopyable() = default;
+
+    public:
+        NonCopyable(const NonCopyable &) = delete;
+        NonCopyable& operator =(const NonCopyable &) = delete;
+    };
+
+    class DigitalIn {
+    public:
+        DigitalIn(PinName pin) : _pin(pin), _mode(PullDefault) {}
+
+        DigitalIn(PinName pin, PinMode mode) : _pin(pin), _mode(mode) {}
+
+        int read() {
+            return sim::gpio_read(_pin);
+        }
+
+        void mode(PinMode pull) {
+            _mode = pull;
+        }
+
+        int is_connected() {
+            return _pin != NC;
+        }
+
+        operator int() {
+            return read();
+        }
+
+    protected:
+        PinName _pin;
+        PinMode _mode;
+    };
+
+    class AnalogIn {
+    public:
+        AnalogIn(PinName pin, float vref = MBED_CONF_TARGET_DEFAULT_ADC_VREF) : 
+            _pin(pin), _vref(vref) {}
+
+        float read() {
+            return read_u16() * (1.0f / 0xFFFF);
+        }
+
+        unsigned short read_u16() {
+            return sim::adc_read(_pin);
+        }
+
+        float read_voltage() {
+            return read() * _vref;
+        }
+
+        void set_reference_voltage(float vref) {
+            _vref = vref;
+        }
+
+        float get_reference_voltage() const {
+            return _vref;
+        }
+
+        operator float() {
+            return read();
+        }
+
+    protected:
+        PinName _pin;
+        float _vref;
+    };
+
+    class PortIn {
+    public:
+        PortIn(PortName port, int mask = 0xFFFFFFFF) : 
+            _port(port), _mask(static_cast<uint32_t>(mask)), _mode(PullDefault) {}
+
+        int read() {
+            return static_cast<int>(sim::port_read(_port, _mask));
+        }
+
+        void mode(PinMode pull) {
+            _mode = pull;
+        }
+
+        operator int() {
+            return read();
+        }
+
+    private:
+        PortName _port;
+        uint32_t _mask;
+        PinMode _mode;
+    };
+
+    // digital input raising rise/fall callbacks, called from the thread that
+    // drives the pin through sim::edge like an ISR
+    class InterruptIn : private NonCopyable<InterruptIn> {
+    public:
+        InterruptIn(PinName pin);
+        InterruptIn(PinName pin, PinMode mode);
+        ~InterruptIn();
+
+        int read() {
+            return sim::gpio_read(_pin);
+        }
+
+        void rise(Callback<void()> func);
+        void fall(Callback<void()> func);
+
+        void mode(PinMode pull) {
+            _mode = pull;
+        }
+
+        // edges while disabled are dropped, not held pending
+        void enable_irq();
+        void disable_irq();
+
+        operator int() {
+            return read();
+        }
+
+    private:
+        static void irq(uintptr_t context, int rising);
+
+        PinName _pin;
+        PinMode _mode;
+        Callback<void()> _rise;
+        Callback<void()> _fall;
+        std::atomic<bool> _enabled;
+    };
+
+    // calls its callback periodically from a background thread, standing in
+    // for the timer interrupt
+    class Ticker : private NonCopyable<Ticker> {
+    public:
+        Ticker();
+        ~Ticker();
+
+        void attach(Callback<void()> func, std::chrono::microseconds t);
+
+        void detach();
+
+    private:
+        struct State;
+        State *state;
+    };
+}
+
+namespace rtos {
+    namespace ThisThread {
+        void sleep_for(std::chrono::milliseconds rel_time);
+    }
+}
+
+using namespace mbed;
+using namespace rtos;
+using namespace std;
+
+#endif // MBED_H
@@ -0,0 +1,1025 @@
+// behaviour checks of the cached bus library against the simulated HAL, run
+// by ctest on the host build
+//
+// usage: cached-bus-tests [case filter]
+
+#include "mbed.h"
+#include "cache_bus.h"
+#include "cache_sampler.h"
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <type_traits>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace Cached;
+
+namespace {
+    constexpr size_t MAX_CASES = 64;
+
+    struct Case {
+        const char *name;
+        void (*run)();
+    };
+
+    Case cases[MAX_CASES];
+    size_t case_count = 0;
+    int failures = 0;
+
+    struct Register {
+        Register(const char *name, void (*run)()) {
+            if (case_count < MAX_CASES) {
+                cases[case_count++] = {name, run};
+            }
+        }
+    };
+
+    void check(bool ok, const char *expr, const char *file, int line) {
+        if (!ok) {
+            printf("    %s:%d: check failed: %s\n", file, line, expr);
+            ++failures;
+        }
+    }
+
+    bool near(float a, float b, float eps = 1e-4f) {
+        return std::fabs(a - b) <= eps;
+    }
+
+    // true if run ends the process with an error, as MBED_ERROR does
+    template <class F>
+    bool dies(F &&run) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            // the error message is expected, keep it out of the test output
+            FILE *quiet = freopen("/dev/null", "w", stderr);
+            (void)quiet;
+            run();
+            _exit(0);
+        }
+
+        int status = 0;
+        waitpid(pid, &status, 0);
+        return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    }
+}
+
+#define TEST_CASE(name) \
+    static void name(); \
+    static Register name##_registered {#name, name}; \
+    static void name()
+
+#define CHECK(expr) check((expr), #expr, __FILE__, __LINE__)
+
+TEST_CASE(sim_script_repeats) {
+    DigitalIn pin(PA_0);
+    sim::script(PA_0, {1, 0, 0});
+
+    CHECK(pin.read() == 1);
+    CHECK(pin.read() == 0);
+    CHECK(pin.read() == 0);
+    CHECK(pin.read() == 1);
+    CHECK(sim::gpio_reads() == 4U);
+
+    // peek shows the last value read without reading again
+    CHECK(sim::peek(PA_0) == 1U);
+    CHECK(sim::gpio_reads() == 4U);
+
+    sim::set(PA_0, 0);
+    CHECK(pin.read() == 0);
+    CHECK(pin.read() == 0);
+}
+
+TEST_CASE(dbus_read_all) {
+    DigitalIn a(PA_0), b(PA_1), c(PB_2);
+    DBus<3> bus {a, b, c};
+
+    sim::set(PA_0, 1);
+    sim::set(PB_2, 1);
+    bus.read_all();
+    CHECK(bus.get<0>() == 1);
+    CHECK(bus.get<1>() == 0);
+    CHECK(bus.get<2>() == 1);
+    CHECK(bus.as_integer() == 0x5U);
+
+    // the cache holds until the next read
+    sim::set(PA_0, 0);
+    CHECK(bus.get<0>() == 1);
+    bus.read<0>();
+    CHECK(bus.get<0>() == 0);
+
+    bus.read_all(true);
+    CHECK(bus.as_integer() == 0x3U);
+}
+
+namespace {
+    // DBus over the first sizeof...(I) pins, levels set by high
+    template <size_t ...I>
+    uint64_t read_wide(uint64_t high, mstd::index_sequence<I...>) {
+        DigitalIn pins[] = {DigitalIn(static_cast<PinName>(I))...};
+        DBus<sizeof...(I)> bus {pins[I]...};
+        for (size_t i = 0; i < sizeof...(I); ++i) {
+            sim::set(static_cast<PinName>(i), (high >> i) & 1U);
+        }
+        bus.read_all();
+        CHECK(bus.template get<sizeof...(I) - 1U>() == static_cast<int>(high >> (sizeof...(I) - 1U) & 1U));
+        return bus.as_integer();
+    }
+}
+
+TEST_CASE(dbus_packs_levels_across_words) {
+    const uint64_t high = (1ULL << 33) | (1ULL << 32) | (1ULL << 31) | 1U;
+    CHECK(read_wide(high, mstd::make_index_sequence<34>()) == high);
+    CHECK(read_wide(1ULL << 39, mstd::make_index_sequence<40>()) == 1ULL << 39);
+    static_assert(sizeof(bus_integer<34>) == 8U && sizeof(bus_integer<16>) == 2U, "as_integer width");
+}
+
+TEST_CASE(dbus_pins_read_per_port) {
+    DBus<4> bus {PA_0, PA_3, PB_1, PC_15};
+
+    sim::set(PA_3, 1);
+    sim::set(PC_15, 1);
+    bus.read_all();
+    CHECK(bus.as_integer() == 0xAU);
+    CHECK(sim::gpio_reads() == 3U);
+
+    // channels 0 and 1 share port A
+    sim::reset_counters();
+    bus.read<1, 0>();
+    CHECK(sim::gpio_reads() == 1U);
+    CHECK(bus.as_integer() == 0xAU);
+}
+
+TEST_CASE(dbus_pins_not_grouped_is_fatal) {
+    CHECK(dies([] { DBus<2> bus {PA_1, NC}; }));
+
+    // one port more than a bus may span
+    CHECK(dies([] {
+        DBus<CACHED_BUS_MAX_PORTS + 1> bus {PA_0, PB_0, PC_0, PD_0, PE_0, PF_0, PG_0, PH_0,
+            static_cast<PinName>(PortCount << 4)};
+    }));
+
+    CHECK(!dies([] { DBus<2> bus {PA_1, PB_1}; }));
+}
+
+TEST_CASE(dbus_debounce_needs_four_reads) {
+    DigitalIn a(PA_0), b(PA_1);
+    DBus<2> bus {a, b};
+    DBus<2> port_bus {PA_0, PA_1};
+    bus.set_debounce(true);
+    port_bus.set_debounce(true);
+
+    sim::set(PA_0, 1);
+    for (int i = 0; i < 3; ++i) {
+        bus.read_all();
+        port_bus.read_all();
+        CHECK(bus.get<0>() == 0);
+        CHECK(port_bus.get<0>() == 0);
+    }
+    bus.read_all();
+    port_bus.read_all();
+    CHECK(bus.get<0>() == 1);
+    CHECK(port_bus.get<0>() == 1);
+    CHECK(bus.get<1>() == 0);
+
+    // a glitch shorter than 4 reads restarts the count
+    sim::script(PA_1, {1, 1, 0});
+    for (int i = 0; i < 3; ++i) {
+        bus.read_all();
+    }
+    CHECK(bus.get<1>() == 0);
+    sim::set(PA_1, 1);
+    for (int i = 0; i < 3; ++i) {
+        bus.read<1>();
+    }
+    CHECK(bus.get<1>() == 0);
+    bus.read<1>();
+    CHECK(bus.get<1>() == 1);
+
+    // without debouncing the cache follows the next read
+    bus.set_debounce(false);
+    sim::set(PA_0, 0);
+    bus.read_all();
+    CHECK(bus.get<0>() == 0);
+}
+
+TEST_CASE(abus_read_all) {
+    AnalogIn a(PA_0), b(PA_1);
+    ABus<2> bus {a, b};
+
+    sim::set(PA_0, 0xFFFF);
+    sim::set(PA_1, 0);
+    bus.read_all();
+    CHECK(near(bus.get<0>(), 1.0f));
+    CHECK(near(bus.get<1>(), 0.0f));
+    CHECK(sim::adc_conversions() == 2U);
+
+    bus.read_all(true);
+    CHECK(near(bus.get<0>(), 0.0f));
+    CHECK(near(bus.get<1>(), 1.0f));
+}
+
+TEST_CASE(abus16_caches_raw_samples) {
+    AnalogIn a(PA_0), b(PA_1);
+    ABus16<2> bus {a, b};
+
+    sim::set(PA_0, 0x8000);
+    sim::set(PA_1, 0xFFFF);
+    bus.read_all();
+    CHECK(bus.get_raw<0>() == 0x8000U);
+    CHECK(bus.raw(1) == 0xFFFFU);
+    CHECK(near(bus.get<0>(), 0x8000 / 65535.0f));
+    CHECK(near(bus[1], 1.0f));
+    CHECK(near(bus.get_voltage<1>(), b.get_reference_voltage()));
+
+    bus.read<0>(true);
+    CHECK(bus.get_raw<0>() == 0x7FFFU);
+    CHECK(bus.get_raw<1>() == 0xFFFFU);
+}
+
+TEST_CASE(dma_abus_scans) {
+    DmaABus<2, sim::AdcDma> bus {PA_0, PA_1};
+    sim::set(PA_0, 0x1000);
+    sim::set(PA_1, 0xFFFF);
+
+    // start returns while the engine converts, nothing is handed out meanwhile
+    sim::set_adc_latency(std::chrono::milliseconds(5));
+    bus.start();
+    Snapshot<uint16_t, 2> snapshot {};
+    CHECK(!bus.ready());
+    CHECK(!bus.try_snapshot(snapshot));
+    bus.wait();
+    CHECK(bus.ready());
+    CHECK(sim::adc_conversions() == 2U);
+    CHECK(bus.get_raw<0>() == 0x1000U);
+    CHECK(near(bus.get<1>(), 1.0f));
+    sim::set_adc_latency(std::chrono::nanoseconds(0));
+
+    CHECK(bus.try_snapshot(snapshot));
+    CHECK(snapshot[0] == 0x1000U && snapshot[1] == 0xFFFFU);
+
+    // inverse_read and per-channel polarity apply to the scan
+    bus.read_all(true);
+    CHECK(bus.get_raw<0>() == 0xEFFFU && bus.get_raw<1>() == 0U);
+    bus.set_polarity(ChannelMask<2>::of({1}));
+    bus.read_all();
+    CHECK(bus.snapshot()[0] == 0x1000U && bus.snapshot()[1] == 0U);
+
+    // changes within the deadband are not reported
+    ChannelMask<2> changed {};
+    bus.set_deadband(0x100);
+    sim::set(PA_0, 0x1080);
+    sim::set(PA_1, 0xFE00);
+    bus.read_all(changed);
+    CHECK(!changed.test<0>() && changed.test<1>());
+    CHECK(bus.get_raw<0>() == 0x1080U);
+
+    // the scan stamp decides whether get_fresh scans again
+    sim::reset_counters();
+    CHECK(bus.get_fresh<0>(std::chrono::seconds(10)) == bus.get<0>());
+    CHECK(sim::adc_conversions() == 0U);
+    ThisThread::sleep_for(std::chrono::milliseconds(2));
+    sim::set(PA_0, 0xFFFF);
+    CHECK(near(bus.get_fresh<0>(std::chrono::milliseconds(1)), 1.0f));
+    CHECK(sim::adc_conversions() == 2U);
+    CHECK(bus.timestamp<0>() == bus.timestamp<1>());
+}
+
+TEST_CASE(abus_avg_oversamples) {
+    AnalogIn a(PA_0), b(PA_1);
+    ABusAvg<2, 4> bus {a, b};
+    sim::script(PA_0, {0, 0xFFFF});
+    sim::script(PA_1, {0, 0, 0, 0xFFFF});
+    bus.read_all();
+    CHECK(sim::adc_conversions() == 8U);
+    CHECK(near(bus.get<0>(), 0.5f));
+    CHECK(near(bus.get<1>(), 0.25f));
+
+    // inverse_read flips the summed samples once, giving 1 - the average
+    bus.read_all(true);
+    CHECK(near(bus.get<0>(), 0.5f));
+    CHECK(near(bus.get<1>(), 0.75f));
+
+    // factors mix per channel in a vbus
+    AnalogIn c(PB_0), d(PB_1);
+    VBus<AnalogAvg<4>, Analog> vbus {c, d};
+    sim::script(PB_0, {0xFFFF, 0, 0, 0});
+    sim::set(PB_1, 0xFFFF);
+    sim::reset_counters();
+    vbus.read_all();
+    CHECK(sim::adc_conversions() == 5U);
+    CHECK(near(vbus.get<0>(), 0.25f));
+    CHECK(near(vbus.get<1>(), 1.0f));
+}
+
+TEST_CASE(vbus_read_all) {
+    DigitalIn d(PA_0);
+    AnalogIn a(PA_1);
+    VBus<Digital, Analog> bus {d, a};
+
+    sim::set(PA_0, 1);
+    sim::set(PA_1, 0x8000);
+    auto values = bus.read_all();
+    CHECK(mstd::get<0>(values) == 1);
+    CHECK(near(mstd::get<1>(values), 0x8000 / 65535.0f));
+    CHECK(bus.get<0>() == 1);
+
+    sim::set(PA_0, 0);
+    CHECK(bus.read<0>() == 0);
+    CHECK(near(bus.get<1>(), 0x8000 / 65535.0f));
+}
+
+TEST_CASE(virtual_channels_read_through_the_vtable) {
+    static_assert(!std::is_polymorphic<Digital>::value && !std::is_polymorphic<Analog>::value,
+        "polled channels carry no vtable");
+
+    DigitalIn d(PA_0);
+    AnalogIn a(PA_1);
+    Virtual<Digital> vd(d);
+    Virtual<Analog> va(a);
+    InputRead<DigitalIn, int> &digital = vd;
+    InputRead<AnalogIn, float> &analog = va;
+
+    sim::set(PA_0, 1);
+    sim::set(PA_1, 0xFFFF);
+    CHECK(digital.read(false) == 1);
+    CHECK(near(analog.read(false), 1.0f));
+    CHECK(digital.read(true) == 0);
+    CHECK(digital.read_cached() == 0);
+    CHECK(near(analog.read_cached(), 1.0f));
+    CHECK(sim::gpio_reads() == 2U && sim::adc_conversions() == 1U);
+}
+
+TEST_CASE(read_all_reports_changes) {
+    DigitalIn d0(PA_0), d1(PA_1);
+    DBus<2> dbus {d0, d1};
+    DBus<2> port_bus {PA_0, PA_1};
+    ChannelMask<2> changed {};
+    dbus.read_all(changed);
+    CHECK(!changed.any());
+
+    // any digital flip counts, whichever way it goes
+    sim::set(PA_1, 1);
+    dbus.read_all(changed);
+    port_bus.read_all();
+    CHECK(!changed.test<0>() && changed.test<1>());
+    sim::set(PA_1, 0);
+    port_bus.read_all(changed);
+    CHECK(!changed.test<0>() && changed.test<1>());
+    dbus.read_all(changed);
+    CHECK(changed.test<1>());
+    dbus.read_all(changed);
+    CHECK(!changed.any());
+
+    // analog channels only change beyond the deadband
+    AnalogIn a0(PB_0), a1(PB_1);
+    ABus<2> abus {a0, a1};
+    ABus16<2> abus16 {a0, a1};
+    abus.set_deadband(0.01f);
+    abus16.set_deadband(0x100);
+    sim::set(PB_0, 0x8000);
+    sim::set(PB_1, 0x8000);
+    abus.read_all();
+    abus16.read_all();
+    sim::set(PB_0, 0x8080);
+    sim::set(PB_1, 0x9000);
+    abus.read_all(changed);
+    CHECK(!changed.test<0>() && changed.test<1>());
+    abus16.read_all(changed);
+    CHECK(!changed.test<0>() && changed.test<1>());
+    // the value below the deadband is still cached
+    CHECK(abus16.get_raw<0>() == 0x8080U);
+
+    // a vbus scales its deadband to each channel's data type
+    DigitalIn vd(PC_0);
+    AnalogIn va(PC_1), vr(PC_2);
+    VBus<Digital, Analog, AnalogU16> vbus {vd, va, vr};
+    ChannelMask<3> vchanged {};
+    vbus.set_deadband(0.01f);
+    sim::set(PC_1, 0x8000);
+    sim::set(PC_2, 0x8000);
+    vbus.read_all();
+    sim::set(PC_0, 1);
+    sim::set(PC_1, 0x8080);
+    sim::set(PC_2, 0x9000);
+    vbus.read_all(vchanged);
+    CHECK(vchanged.test<0>() && !vchanged.test<1>() && vchanged.test<2>());
+    sim::set(PC_1, 0x9000);
+    sim::set(PC_2, 0x9080);
+    vbus.read_all(vchanged);
+    CHECK(!vchanged.test<0>() && vchanged.test<1>() && !vchanged.test<2>());
+}
+
+TEST_CASE(in_place_buses_own_their_inputs) {
+    InPlaceBus<Analog, 2> abus {PA_0, PA_1};
+    sim::set(PA_1, 0xFFFF);
+    abus.read_all();
+    CHECK(sim::adc_conversions() == 2U);
+    CHECK(near(abus.get<0>(), 0.0f));
+    CHECK(near(abus.get<1>(), 1.0f));
+
+    InPlaceBus<Digital, 3> dbus {PB_0, PB_1, PB_2};
+    sim::set(PB_0, 1);
+    sim::set(PB_2, 1);
+    dbus.read_all();
+    CHECK(dbus.as_integer() == 0x5U);
+    dbus.read<1>(true);
+    CHECK(dbus.get<1>() == 1);
+
+    InPlaceVBus<Digital, Analog> vbus {true, PC_0, PC_1};
+    sim::set(PC_1, 0xFFFF);
+    vbus.read_all();
+    CHECK(vbus.get<0>() == 1);
+    CHECK(near(vbus.get<1>(), 0.0f));
+}
+
+TEST_CASE(vbus_view_references_cache) {
+    DigitalIn d(PA_0);
+    AnalogIn a(PA_1);
+    VBus<Digital, Analog> bus {d, a};
+    auto view = bus.view();
+    auto [level, value] = view;
+    static_assert(mstd::is_same<decltype(level), const int &>::value, "view binds the cached level");
+    static_assert(mstd::is_same<decltype(Cached::get<1>(view)), const float &>::value,
+        "view get<I> returns a reference");
+    CHECK(&Cached::get<0>(view) == &level);
+    CHECK(&view.get<1>() == &value);
+
+    // later reads show through the bindings without copying
+    sim::set(PA_0, 1);
+    sim::set(PA_1, 0xFFFF);
+    bus.read_all();
+    CHECK(level == 1);
+    CHECK(near(value, 1.0f));
+    CHECK(near(Cached::get<1>(view), 1.0f));
+}
+
+TEST_CASE(timestamps_and_get_fresh) {
+    DigitalIn a(PA_0), b(PA_1);
+    DBus<2> bus {a, b};
+    DBus<2, false> unstamped {a, b};
+    static_assert(sizeof(DBus<64, false>) + 64U * sizeof(uint32_t) <= sizeof(DBus<64>),
+        "unstamped bus still keeps its stamps");
+
+    CHECK(bus.timestamp<0>() == 0U);
+    bus.read_all();
+    CHECK(bus.timestamp<0>() != 0U);
+    CHECK(bus.timestamp<1>() == bus.timestamp<0>());
+
+    // fresh enough, served from the cache
+    sim::set(PA_0, 1);
+    sim::reset_counters();
+    CHECK(bus.get_fresh<0>(std::chrono::seconds(10)) == 0);
+    CHECK(sim::gpio_reads() == 0U);
+
+    // too old, read again
+    ThisThread::sleep_for(std::chrono::milliseconds(2));
+    CHECK(bus.get_fresh<0>(std::chrono::milliseconds(1)) == 1);
+    CHECK(sim::gpio_reads() == 1U);
+
+    // a bus without stamps reads every time
+    unstamped.read_all();
+    CHECK(unstamped.timestamp<0>() == 0U);
+    sim::reset_counters();
+    CHECK(unstamped.get_fresh<0>(std::chrono::seconds(10)) == 1);
+    CHECK(sim::gpio_reads() == 1U);
+
+    AnalogIn an(PB_0);
+    ABus16<1, false> abus {an};
+    sim::set(PB_0, 0xFFFF);
+    CHECK(near(abus.get_fresh<0>(std::chrono::seconds(10)), 1.0f));
+    CHECK(abus.timestamp<0>() == 0U);
+}
+
+TEST_CASE(ema_filters_attached_buses) {
+    AnalogIn a(PA_0), b(PA_1);
+    ABus<2> abus {a, b};
+    ABus16<2> abus16 {a, b};
+    Ema<2> lowpass, lowpass16;
+    lowpass.set_shift(1);
+    lowpass16.set_shift(2);
+    abus.set_filter(&lowpass);
+    abus16.set_filter(&lowpass16);
+
+    // each channel starts from its first sample
+    abus.read_all();
+    abus16.read_all();
+    CHECK(near(abus.get<0>(), 0.0f));
+    CHECK(abus16.get_raw<0>() == 0U);
+
+    sim::set(PA_0, 0xFFFF);
+    abus.read_all();
+    abus16.read_all();
+    CHECK(near(abus.get<0>(), 0.5f));
+    CHECK(abus16.get_raw<0>() == 0x4000U);
+    abus.read<0>();
+    CHECK(near(abus.get<0>(), 0.75f));
+    CHECK(near(abus.get<1>(), 0.0f));
+
+    // detached, the cache takes the samples as read
+    abus.set_filter(nullptr);
+    abus.read_all();
+    CHECK(near(abus.get<0>(), 1.0f));
+
+    // per channel shifts, the digital channel passes through
+    DigitalIn d(PB_0);
+    AnalogIn an(PB_1);
+    VBus<Digital, Analog> vbus {d, an};
+    Ema<2> vlowpass;
+    vlowpass.set_shift(1, 1);
+    vbus.set_filter(&vlowpass);
+    vbus.read_all();
+    sim::set(PB_0, 1);
+    sim::set(PB_1, 0xFFFF);
+    vbus.read_all();
+    CHECK(vbus.get<0>() == 1);
+    CHECK(near(vbus.get<1>(), 0.5f));
+}
+
+TEST_CASE(running_stats_values) {
+    AnalogIn a(PA_0), b(PA_1);
+    ABus<1> abus {a};
+    RunningStats<float, 1> stats;
+    abus.set_stats(&stats);
+
+    sim::script(PA_0, {0, 0xFFFF, 0xFFFF, 0});
+    for (int i = 0; i < 4; ++i) {
+        abus.read_all();
+    }
+    CHECK(stats.count(0) == 4U);
+    CHECK(near(stats.min(0), 0.0f));
+    CHECK(near(stats.max(0), 1.0f));
+    CHECK(near(stats.mean(0), 0.5f));
+    CHECK(near(stats.variance(0), 0.25f));
+
+    // raw steps keep exact sums
+    ABus16<2> abus16 {a, b};
+    RunningStats<uint16_t, 2> raw;
+    abus16.set_stats(&raw);
+    sim::script(PA_0, {100, 300, 200});
+    sim::set(PA_1, 0x8000);
+    abus16.read_all();
+    abus16.read_all();
+    abus16.read<0>();
+    CHECK(raw.count(0) == 3U);
+    CHECK(raw.count(1) == 2U);
+    CHECK(raw.min(0) == 100U && raw.max(0) == 300U);
+    CHECK(near(raw.mean(0), 200.0f));
+    CHECK(near(raw.variance(0), 20000.0f / 3.0f, 1e-2f));
+    CHECK(near(raw.mean(1), 0x8000) && near(raw.variance(1), 0.0f));
+
+    // reset starts over now, restart with the next sample
+    raw.reset();
+    CHECK(raw.count(0) == 0U);
+    abus16.read_all();
+    raw.restart();
+    CHECK(raw.count(0) == 1U);
+    abus16.read_all();
+    CHECK(raw.count(0) == 1U && raw.count(1) == 1U);
+
+    // detached, reads leave the window alone
+    abus16.set_stats(nullptr);
+    abus16.read_all();
+    CHECK(raw.count(0) == 1U);
+
+    // a vbus adds whichever channels each read refreshed
+    DigitalIn d(PB_0);
+    AnalogIn x(PB_1), y(PB_2);
+    VBus<Digital, Analog, Analog> vbus {d, x, y};
+    RunningStats<float, 3> vstats;
+    vbus.set_stats(&vstats);
+    sim::set(PB_0, 1);
+    sim::set(PB_1, 0xFFFF);
+    vbus.read_all();
+    vbus.read<1, 2>();
+    vbus.read<0>();
+    CHECK(vstats.count(0) == 2U);
+    CHECK(vstats.count(1) == 2U);
+    CHECK(vstats.count(2) == 2U);
+    CHECK(near(vstats.mean(0), 1.0f));
+    CHECK(near(vstats.max(1), 1.0f));
+    CHECK(near(vstats.max(2), 0.0f));
+}
+
+TEST_CASE(polarity_xor_inverse_read) {
+    DigitalIn d0(PA_0), d1(PA_1);
+    DBus<2> dbus {d0, d1};
+    DBus<2> port_bus {PA_0, PA_1};
+    dbus.set_polarity(ChannelMask<2>::of({1}));
+    port_bus.set_polarity(ChannelMask<2>::of({1}));
+
+    sim::set(PA_0, 1);
+    sim::set(PA_1, 1);
+    dbus.read_all();
+    port_bus.read_all();
+    CHECK(dbus.as_integer() == 0x1U);
+    CHECK(port_bus.as_integer() == 0x1U);
+
+    // inverse_read flips every channel on top of its polarity
+    dbus.read_all(true);
+    port_bus.read_all(true);
+    CHECK(dbus.as_integer() == 0x2U);
+    CHECK(port_bus.as_integer() == 0x2U);
+    dbus.read<1>(true);
+    CHECK(dbus.get<1>() == 1);
+    port_bus.read_mask(0x3U);
+    CHECK(port_bus.as_integer() == 0x1U);
+
+    AnalogIn a0(PB_0), a1(PB_1);
+    ABus<2> abus {a0, a1};
+    ABus16<2> abus16 {a0, a1};
+    abus.set_polarity(ChannelMask<2>::of({0}));
+    abus16.set_polarity(ChannelMask<2>::of({0}));
+    sim::set(PB_0, 0x1000);
+    sim::set(PB_1, 0x1000);
+    abus.read_all();
+    abus16.read_all();
+    CHECK(near(abus.get<0>(), 1.0f - 0x1000 / 65535.0f));
+    CHECK(near(abus.get<1>(), 0x1000 / 65535.0f));
+    CHECK(abus16.get_raw<0>() == 0xEFFFU);
+    CHECK(abus16.get_raw<1>() == 0x1000U);
+    abus16.read_all(true);
+    CHECK(abus16.get_raw<0>() == 0x1000U);
+    CHECK(abus16.get_raw<1>() == 0xEFFFU);
+
+    // Inverted<T> fixes the polarity at compile time, set_polarity and
+    // inverse_read still flip on top
+    DigitalIn v0(PC_0), v1(PC_1);
+    VBus<Digital, Inverted<Digital>> vbus {v0, v1};
+    sim::set(PC_0, 1);
+    sim::set(PC_1, 1);
+    vbus.read_all();
+    CHECK(vbus.get<0>() == 1);
+    CHECK(vbus.get<1>() == 0);
+    vbus.set_polarity(ChannelMask<2>::of({0, 1}));
+    vbus.read_all();
+    CHECK(vbus.get<0>() == 0);
+    CHECK(vbus.get<1>() == 1);
+    vbus.read_all(true);
+    CHECK(vbus.get<0>() == 1);
+    CHECK(vbus.get<1>() == 0);
+}
+
+TEST_CASE(read_lists_read_each_channel_once) {
+    AnalogIn a(PA_0), b(PA_1), c(PA_2);
+    ABus<3> abus {a, b, c};
+    sim::set(PA_2, 0xFFFF);
+    abus.read<2, 0, 2>();
+    CHECK(sim::adc_conversions() == 2U);
+    CHECK(near(abus.get<2>(), 1.0f));
+
+    DigitalIn d0(PB_0), d1(PB_1);
+    DBus<2> dbus {d0, d1};
+    sim::set(PB_1, 1);
+    dbus.read<1, 1>();
+    CHECK(sim::gpio_reads() == 1U);
+    CHECK(dbus.get<1>() == 1);
+
+    // the result keeps the order of the list, duplicates included
+    DigitalIn d(PC_0);
+    AnalogIn an(PC_1);
+    VBus<Digital, Analog> vbus {d, an};
+    sim::set(PC_0, 1);
+    sim::set(PC_1, 0);
+    sim::reset_counters();
+    auto values = vbus.read<1, 0, 1>();
+    CHECK(sim::gpio_reads() + sim::adc_conversions() == 2U);
+    CHECK(near(mstd::get<0>(values), 0.0f));
+    CHECK(mstd::get<1>(values) == 1);
+    CHECK(near(mstd::get<2>(values), 0.0f));
+}
+
+TEST_CASE(read_mask_clips_to_bus_width) {
+    CHECK(ChannelMask<3>::from_integer(0xFFU).words[0] == 0x7U);
+    CHECK(ChannelMask<3>::of({1, 5}).words[0] == 0x2U);
+    ChannelMask<40> wide = ChannelMask<40>::from_integer(~0ULL);
+    CHECK(wide.words[0] == 0xFFFFFFFFU && wide.words[1] == 0xFFU);
+    ChannelMask<64> full = ChannelMask<64>::from_integer(~0ULL);
+    CHECK(full.words[0] == 0xFFFFFFFFU && full.words[1] == 0xFFFFFFFFU);
+
+    // ~0 reads every channel and nothing past them
+    DigitalIn a(PA_0), b(PA_1), c(PA_2);
+    DBus<3> dbus {a, b, c};
+    sim::set(PA_0, 1);
+    sim::set(PA_1, 1);
+    sim::set(PA_2, 1);
+    dbus.read_mask(static_cast<uint8_t>(0xFFU));
+    CHECK(sim::gpio_reads() == 3U);
+    CHECK(dbus.as_integer() == 0x7U);
+
+    DBus<3> port_bus {PA_0, PA_1, PA_2};
+    port_bus.read_mask(static_cast<uint8_t>(0xFFU));
+    CHECK(port_bus.as_integer() == 0x7U);
+
+    AnalogIn x(PB_0), y(PB_1);
+    ABus<2> abus {x, y};
+    sim::set(PB_1, 0xFFFF);
+    sim::reset_counters();
+    abus.read_mask(static_cast<uint8_t>(0xFEU));
+    CHECK(sim::adc_conversions() == 1U);
+    CHECK(near(abus.get<1>(), 1.0f));
+    abus.read({1, 7});
+    CHECK(sim::adc_conversions() == 2U);
+}
+
+TEST_CASE(interrupt_digital_follows_edges) {
+    sim::set(PA_0, 1);
+    InterruptIn irq(PA_0);
+    AnalogIn an(PA_1);
+    VBus<InterruptDigital, Analog> bus {irq, an};
+
+    // sampled once when the handlers are attached
+    CHECK(bus.get<0>() == 1);
+
+    sim::edge(PA_0, 0);
+    CHECK(bus.get<0>() == 0);
+    sim::edge(PA_0, 1);
+    CHECK(bus.get<0>() == 1);
+
+    // no hardware access for the interrupt channel
+    sim::set(PA_1, 0xFFFF);
+    sim::reset_counters();
+    auto values = bus.read_all();
+    CHECK(mstd::get<0>(values) == 1);
+    CHECK(near(mstd::get<1>(values), 1.0f));
+    CHECK(sim::gpio_reads() == 0U);
+    CHECK(sim::adc_conversions() == 1U);
+
+    // a new polarity reads the pin once, later edges follow it
+    bus.read_all(true);
+    CHECK(bus.get<0>() == 0);
+    CHECK(sim::gpio_reads() == 1U);
+    sim::edge(PA_0, 0);
+    CHECK(bus.get<0>() == 1);
+
+    // an in-place bus takes edges the same way
+    InPlaceVBus<Analog, InterruptDigital> in_place {PB_0, PB_1};
+    CHECK(in_place.get<1>() == 0);
+    sim::edge(PB_1, 1);
+    CHECK(in_place.get<1>() == 1);
+}
+
+TEST_CASE(history_segments_wrap) {
+    AnalogIn a(PA_0), b(PA_1);
+    ABus16<2> bus {a, b};
+    History<uint16_t, 2, 3> history;
+    bus.set_history(&history);
+
+    sim::script(PA_0, {10, 20, 30, 40, 50});
+    bus.read_all();
+    bus.read_all();
+    CHECK(history.size(0) == 2U);
+    CHECK(history.values_of(0, 0).size() == 2U);
+    CHECK(history.values_of(0, 1).size() == 0U);
+    CHECK(history.values_of(0, 0)[0] == 10U);
+    CHECK(history.value(0, 0) == 20U);
+
+    // 5 samples in a ring of 3: 30 is the oldest left, after the wrap
+    bus.read_all();
+    bus.read_all();
+    bus.read<0>();
+    CHECK(history.size(0) == 3U);
+    CHECK(history.size(1) == 3U);
+    auto older = history.values_of(0, 0);
+    auto newer = history.values_of(0, 1);
+    CHECK(older.size() == 1U && older[0] == 30U);
+    CHECK(newer.size() == 2U && newer[0] == 40U && newer[1] == 50U);
+    CHECK(history.value(0, 0) == 50U);
+    CHECK(history.value(0, 2) == 30U);
+    CHECK(history.stamps_of(0, 0).size() == 1U);
+    CHECK(history.stamps_of(0, 1).size() == 2U);
+    CHECK(history.stamp(0, 0) == bus.timestamp<0>());
+
+    // detached, reads no longer record
+    bus.set_history(nullptr);
+    bus.read_all();
+    CHECK(history.value(0, 0) == 50U);
+}
+
+TEST_CASE(vbus_history_records_reads) {
+    DigitalIn d(PA_0);
+    AnalogIn x(PA_1), y(PA_2);
+    VBus<Digital, Analog, Analog> bus {d, x, y};
+    History<float, 3, 4> history;
+    bus.set_history(&history);
+
+    sim::set(PA_0, 1);
+    sim::set(PA_1, 0xFFFF);
+    bus.read_all();
+    CHECK(history.size(0) == 1U && history.size(1) == 1U && history.size(2) == 1U);
+    CHECK(near(history.value(0, 0), 1.0f));
+    CHECK(near(history.value(1, 0), 1.0f));
+    CHECK(near(history.value(2, 0), 0.0f));
+
+    // partial reads record only the channels they refreshed, with their read time
+    sim::set(PA_2, 0xFFFF);
+    bus.read<2, 1>();
+    bus.read<2>();
+    CHECK(history.size(0) == 1U);
+    CHECK(history.size(1) == 2U);
+    CHECK(history.size(2) == 3U);
+    CHECK(near(history.value(2, 0), 1.0f) && near(history.value(2, 2), 0.0f));
+    CHECK(history.stamp(2, 0) >= history.stamp(2, 2));
+
+    bus.set_history(nullptr);
+    bus.read_all();
+    CHECK(history.size(0) == 1U);
+}
+
+TEST_CASE(sampler_reports_overruns) {
+    AnalogIn a(PA_0);
+    ABus16<1> bus {a};
+    Sampler<ABus16<1>> sampler {bus, std::chrono::milliseconds(1)};
+
+    // every refresh takes longer than the period
+    sim::set_adc_latency(std::chrono::milliseconds(3));
+    for (int i = 0; i < 3; ++i) {
+        sampler.sample();
+    }
+    SamplerStats stats = sampler.stats();
+    CHECK(stats.samples == 3U);
+    CHECK(stats.overruns == 3U);
+    CHECK(stats.max_duration_us >= 3000U);
+    CHECK(stats.rate_hz > 0.0f && stats.rate_hz < 1000.0f);
+    CHECK(stats.dropped == 0U);
+
+    // a refresh starting while the last one still reads is skipped and counted.
+    // the read outlasts a scheduler time slice, so the skipped one runs inside it
+    sampler.reset_stats();
+    sim::reset_counters();
+    sim::set_adc_latency(std::chrono::milliseconds(50));
+    std::thread slow([&] { sampler.sample(); });
+    while (sim::adc_conversions() == 0) {
+        std::this_thread::yield();
+    }
+    sampler.sample();
+    slow.join();
+    stats = sampler.stats();
+    CHECK(stats.samples == 1U);
+    CHECK(stats.overruns == 2U);
+    CHECK(sim::adc_conversions() == 1U);
+
+    // on time, nothing more is counted
+    sim::set_adc_latency(std::chrono::nanoseconds(0));
+    sampler.reset_stats();
+    sampler.sample();
+    CHECK(sampler.stats().overruns == 0U);
+    CHECK(sampler.stats().max_duration_us < 1000U);
+}
+
+TEST_CASE(sample_queue_counts_overflows) {
+    AnalogIn a(PA_0), b(PA_1);
+    ABus16<2> bus {a, b};
+    Sampler<ABus16<2>> sampler {bus, std::chrono::seconds(1)};
+    SampleQueue<ABus16<2>, 4> queue;
+    sampler.set_queue(&queue);
+
+    sim::script(PA_0, {1, 2, 3, 4, 5, 6, 7});
+    for (int i = 0; i < 6; ++i) {
+        sampler.sample();
+    }
+    CHECK(queue.size() == 4U);
+    CHECK(queue.overflows() == 2U);
+    CHECK(queue.high_water() == 4U);
+    CHECK(sampler.stats().samples == 6U);
+    CHECK(sampler.stats().dropped == 2U);
+
+    // the first refreshes are kept, oldest first, in batches
+    uint16_t seen[4] = {};
+    size_t count = 0;
+    CHECK(queue.drain([&](const BusSample<ABus16<2>> &record) { seen[count++] = record.values[0]; }, 3U) == 3U);
+    CHECK(queue.drain([&](const BusSample<ABus16<2>> &record) { seen[count++] = record.values[0]; }) == 1U);
+    CHECK(seen[0] == 1U && seen[1] == 2U && seen[2] == 3U && seen[3] == 4U);
+    CHECK(queue.size() == 0U);
+
+    CHECK(queue.take_overflows() == 2U);
+    CHECK(queue.overflows() == 0U);
+
+    BusSample<ABus16<2>> record;
+    sampler.sample();
+    CHECK(queue.pop(record) && record.values[0] == 7U);
+    CHECK(!queue.pop(record));
+}
+
+TEST_CASE(seqlock_write_sections) {
+    SeqLock lock;
+    uint32_t idle = lock.read_begin();
+    CHECK(lock.read_valid(idle));
+
+    lock.write_begin();
+    uint32_t during = lock.read_begin();
+    CHECK(!lock.read_valid(during));
+
+    // a nested section does not publish
+    lock.write_begin();
+    lock.write_end();
+    CHECK(!lock.read_valid(lock.read_begin()));
+
+    lock.write_end();
+    CHECK(!lock.read_valid(idle));
+    CHECK(lock.read_valid(lock.read_begin()));
+}
+
+TEST_CASE(snapshot_never_torn) {
+    constexpr size_t STEPS = 1000;
+
+    uint16_t steps[STEPS];
+    for (size_t i = 0; i < STEPS; ++i) {
+        steps[i] = static_cast<uint16_t>(i * 61U);
+    }
+
+    // every refresh reads the same step on all channels
+    AnalogIn a(PA_0), b(PA_1), c(PA_2), d(PA_3);
+    for (PinName pin : {PA_0, PA_1, PA_2, PA_3}) {
+        sim::script(pin, steps, STEPS);
+    }
+    ABus16<4> bus {a, b, c, d};
+
+    // long enough for the scheduler to preempt the writer mid-refresh many times
+    std::atomic<bool> done {false};
+    std::thread writer([&] {
+        while (!done.load()) {
+            bus.read_all();
+        }
+    });
+
+    int snapshots = 0, torn = 0;
+    auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(200);
+    while (std::chrono::steady_clock::now() < until) {
+        auto snapshot = bus.snapshot();
+        torn += snapshot[1] != snapshot[0] || snapshot[2] != snapshot[0] || snapshot[3] != snapshot[0];
+        ++snapshots;
+    }
+    done.store(true);
+    writer.join();
+
+    CHECK(snapshots > 0);
+    CHECK(torn == 0);
+}
+
+namespace {
+    // scan engine converting synchronously, which lets a snapshot run inside
+    // start() in the window a real ISR could preempt
+    struct HookedDma {
+        uint16_t *dest = nullptr;
+        std::function<void()> on_start;
+
+        void configure(const PinName *, size_t, uint16_t *dest) {
+            this->dest = dest;
+        }
+
+        void start() {
+            if (on_start) {
+                on_start();
+            }
+            dest[0] = 0x1000;
+            dest[1] = 0x2000;
+        }
+
+        bool busy() const {
+            return false;
+        }
+    };
+}
+
+TEST_CASE(dma_snapshot_covers_start) {
+    DmaABus<2, HookedDma> bus {PA_0, PA_1};
+    bus.read_all();
+
+    // an inverted scan has started but not converted, the old samples must not
+    // be handed out with the new polarity
+    Snapshot<uint16_t, 2> during {};
+    bool taken = true;
+    bus.engine().on_start = [&] { taken = bus.try_snapshot(during); };
+    bus.read_all(true);
+    CHECK(!taken);
+
+    Snapshot<uint16_t, 2> after {};
+    bus.engine().on_start = nullptr;
+    CHECK(bus.try_snapshot(after));
+    CHECK(after[0] == 0xEFFFU && after[1] == 0xDFFFU);
+}
+
+int main(int argc, char **argv) {
+    const char *filter = argc > 1 ? argv[1] : nullptr;
+
+    size_t run = 0;
+    for (size_t i = 0; i < case_count; ++i) {
+        if (filter && !strstr(cases[i].name, filter)) {
+            continue;
+        }
+
+        sim::reset();
+        int before = failures;
+        cases[i].run();
+        printf("%-40s %s\n", cases[i].name, failures == before ? "ok" : "FAILED");
+        ++run;
+    }
+
+    printf("%zu cases, %d failed checks\n", run, failures);
+    return failures ? 1 : 0;
+}